@@ -13,10 +13,15 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <libevdev/libevdev.h>
 #include <limits.h>
+#include <math.h>
 #include <linux/fb.h>
 #include <linux/input.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -25,62 +30,89 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__) || defined(__arm__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#endif
+
 #include "version.h"
 
 #define DISPLAY_MIN_XRES	800
 #define DISPLAY_MIN_YRES	320
-#define DISPLAY_MIN_BPP		(32 / CHAR_BIT)
-#define DISPLAY_FRAME_RATE	60
-#define DISPLAY_BG_CYCLE	60
+#define DISPLAY_MIN_BPP		(16 / CHAR_BIT)
+#define DISPLAY_MAX_BPP		(32 / CHAR_BIT)
+#define DISPLAY_DEFAULT_FRAME_RATE	60
+#define DISPLAY_MAX_FRAME_RATE	1000
+#define DISPLAY_BG_CYCLE_NS	(1 * NSEC_PER_SEC)
 
 #define INPUT_DEFAULT_XSIZE	50
 #define INPUT_DEFAULT_YSIZE	40
 #define INPUT_DEFAULT_FADE	2
 #define INPUT_MAX_FADE		64
+#define INPUT_RING_SIZE		1024
+#define INPUT_BATCH_SIZE	64
+#define INPUT_FLUSH_FRAMES	3
+#define INPUT_RECONNECT_RETRY_MS	1000
+
+#define COVERAGE_DWELL_GAP_NS	(50 * NSEC_PER_MSEC)
+
+#define ANALYSE_MAX_SLOTS	16
+#define ANALYSE_STILL_MIN	8
+#define ANALYSE_STILL_RADIUS	4
+#define ANALYSE_STILL_DIV	100
+#define ANALYSE_STUCK_NS	(5 * NSEC_PER_SEC)
 
 #define TEST_PATTERN_BORDER	1
 
+#define RENDER_DEFAULT_THREADS	1
+#define RENDER_MAX_THREADS	16
+
+#define REALTIME_DEFAULT_PRIORITY	50
+#define JITTER_INTERVAL_NS	(1 * NSEC_PER_MSEC)
+#define JITTER_SELFTEST_NS	(1 * NSEC_PER_SEC)
+
+#define STATION_MAX		16
+
+#define ARENA_ALIGN		64
+#define ARENA_HUGE_PAGE		(2UL * 1024 * 1024)
+
 #define DEV_INPUT_EVENT "/dev/input"
 #define EVENT_DEV_NAME "event"
 #define DEV_FB "/dev"
 #define FB_DEV_NAME "fb"
+#define SYSFS_ROOT "/sys"
+#define SYSFS_INPUT "/class/input"
+#define SYSFS_GRAPHICS "/class/graphics"
+#define SYSFS_ATTR_MAX 256
 
-#define CHAN_A		3
-#define CHAN_R		2
-#define CHAN_G		1
-#define CHAN_B		0
-
-
-static volatile bool renderloop_stop = false;
-
-/**
- * siginit_handler - interrupt signal handler
- *
- * @signo:	interrupt signal causing the signal
- *
- * Whenever an interrupt signal is emitted (ctrl-c etc) this will tell the
- * renderloop to stop and cleanup.
- *
- */
-void sigint_handler(int signo) {
-	renderloop_stop = true;
-}
+#define NSEC_PER_USEC	1000ULL
+#define NSEC_PER_MSEC	1000000ULL
+#define NSEC_PER_SEC	1000000000ULL
 
 /**
- * FPS() - convert a given framerate to milliseconds
+ * FRAME_PERIOD_NS() - convert a given framerate to a period in nanoseconds
  *
  * @__fps:	framerate in Hz to convert
  *
- * Return:	framerate in milliseconds
+ * Return:	frame period in nanoseconds
  */
-#define FPS(__fps)	((1 * 1000) / ((__fps) ? (__fps) : 1))
+#define FRAME_PERIOD_NS(__fps)	(NSEC_PER_SEC / ((__fps) ? (__fps) : 1))
 
 /**
  * ARRAY_SIZE() - helper macro to get the number of elements in an array
@@ -92,25 +124,13 @@ void sigint_handler(int signo) {
 #define ARRAY_SIZE(__array) (sizeof(__array) / sizeof((__array)[0]))
 
 /**
- * clamp() - helper macro to clamp a value
- *
- * @__val:	value to clamp
- * @__int:	interval to clamp at
- *
- * This helper macro is used to clamp an input @__val within a certain @__int.
- * For example, if @__val would be 125, then with a @__int of 50 the macro
- * will return the nearest down rounded interval, 100 in this case.
+ * ARENA_SIZE() - helper macro to get the space a buffer takes up in an arena
  *
- * In other words:
- *   __val
- * (   /   ) * __int
- *   __int
+ * @__len:	length of the buffer in bytes
  *
- *
- * Return:	clamped value.
+ * Return:	@__len rounded up to a multiple of ARENA_ALIGN.
  */
-#define clamp(__val, __int) \
-	(((__val) / ((__int) > 0 ? (__int) : 1)) * (__int))
+#define ARENA_SIZE(__len)	(((size_t)(__len) + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1))
 
 /**
  * sat_sub() - saturated subtraction
@@ -152,6 +172,189 @@ uint8_t sat_add(uint8_t to, uint8_t val)
 	return res;
 }
 
+/**
+ * now_ns() - get the current monotonic time
+ *
+ * Return:	CLOCK_MONOTONIC time in nanoseconds.
+ */
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * NSEC_PER_SEC) + ts.tv_nsec;
+}
+
+#define HIST_SUB_BITS	4
+#define HIST_SUB_COUNT	(1 << HIST_SUB_BITS)
+#define HIST_BUCKETS	((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+/**
+ * struct histogram - fixed memory log-linear histogram
+ *
+ * @count:	number of recorded values
+ * @min:	smallest recorded value
+ * @max:	largest recorded value
+ * @sum:	sum of all recorded values
+ * @buckets:	number of recorded values per bucket
+ *
+ * Values below HIST_SUB_COUNT are recorded exactly, every power of two above
+ * that is split into HIST_SUB_COUNT linear buckets. This keeps the relative
+ * error of a recorded value below 1 / HIST_SUB_COUNT over the entire 64-bit
+ * range using only a few kilobytes.
+ */
+struct histogram {
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	uint64_t sum;
+	uint32_t buckets[HIST_BUCKETS];
+};
+
+/**
+ * hist_bucket() - get the bucket index of a value
+ *
+ * @val:	value to look up
+ *
+ * Return:	index into histogram.buckets.
+ */
+static inline uint32_t hist_bucket(const uint64_t val)
+{
+	uint32_t exp;
+
+	if (val < HIST_SUB_COUNT)
+		return val;
+
+	exp = (63 - __builtin_clzll(val));
+
+	return ((exp - HIST_SUB_BITS + 1) << HIST_SUB_BITS) |
+	       ((val >> (exp - HIST_SUB_BITS)) & (HIST_SUB_COUNT - 1));
+}
+
+/**
+ * hist_value() - get the highest value recorded in a bucket
+ *
+ * @bucket:	index into histogram.buckets
+ *
+ * Return:	the highest value that maps onto @bucket.
+ */
+static inline uint64_t hist_value(const uint32_t bucket)
+{
+	uint32_t shift;
+
+	if (bucket < HIST_SUB_COUNT)
+		return bucket;
+
+	shift = (bucket >> HIST_SUB_BITS) - 1;
+
+	return (((uint64_t)(HIST_SUB_COUNT | (bucket & (HIST_SUB_COUNT - 1))) + 1) << shift) - 1;
+}
+
+/**
+ * hist_reset() - clear all recorded values of a histogram
+ *
+ * @hist:	histogram to clear
+ */
+static void hist_reset(struct histogram *hist)
+{
+	memset(hist, 0, sizeof(*hist));
+	hist->min = UINT64_MAX;
+}
+
+/**
+ * hist_add() - record a value into a histogram
+ *
+ * @hist:	histogram to record into
+ * @val:	value to record
+ */
+static inline void hist_add(struct histogram *hist, const uint64_t val)
+{
+	hist->buckets[hist_bucket(val)]++;
+	hist->count++;
+	hist->sum += val;
+	if (val < hist->min)
+		hist->min = val;
+	if (val > hist->max)
+		hist->max = val;
+}
+
+/**
+ * hist_percentile() - get a percentile of the recorded values
+ *
+ * @hist:	histogram to query
+ * @pct:	percentile to get, between 0 and 100
+ *
+ * Return:	upper bound of the @pct percentile, 0 if nothing was recorded.
+ */
+static uint64_t hist_percentile(const struct histogram *hist, const double pct)
+{
+	uint64_t target, seen = 0;
+	uint32_t i;
+
+	if (!hist->count)
+		return 0;
+
+	target = (uint64_t)((hist->count * pct / 100.0) + 0.5);
+	if (target < 1)
+		target = 1;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if (seen >= target)
+			break;
+	}
+	if (i >= HIST_BUCKETS)
+		return hist->max;
+
+	return (hist_value(i) < hist->max) ? hist_value(i) : hist->max;
+}
+
+/**
+ * hist_print() - print the percentiles of a histogram of durations
+ *
+ * @name:	name of the recorded durations
+ * @hist:	histogram of durations in nanoseconds to print
+ */
+static void hist_print(const char *name, const struct histogram *hist)
+{
+	printf("%s: p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n", name,
+	       hist_percentile(hist, 50) / (double)NSEC_PER_MSEC,
+	       hist_percentile(hist, 95) / (double)NSEC_PER_MSEC,
+	       hist_percentile(hist, 99) / (double)NSEC_PER_MSEC,
+	       hist->max / (double)NSEC_PER_MSEC);
+}
+
+/**
+ * struct pixel_format - memory layout of a pixel
+ *
+ * @name:	name of the format, as its DRM fourcc name
+ * @bpp:	bytes per pixel
+ * @red:	bitfield of the red channel within a pixel
+ * @green:	bitfield of the green channel within a pixel
+ * @blue:	bitfield of the blue channel within a pixel
+ * @transp:	bitfield of the alpha channel within a pixel, zero length if none
+ * @span:	renderer of a span of pixels, specialised for @bpp
+ * @span_band:	renderer of a span of pixels onto a banded line, specialised
+ *		for @bpp
+ *
+ * Pixels are packed into a pattern of 32 bits in memory order once per color,
+ * see pixel_pack(), so that the span renderers only ever replicate and invert
+ * a pattern and never look at the individual channels.
+ */
+struct pixel_format {
+	const char *name;
+	uint8_t bpp;
+	struct fb_bitfield red;
+	struct fb_bitfield green;
+	struct fb_bitfield blue;
+	struct fb_bitfield transp;
+	void (*span)(uint8_t *line, const uint8_t *band, const uint32_t pixel,
+		     const uint32_t mask, const uint32_t start, const uint32_t end);
+	void (*span_band)(uint8_t *line, const uint8_t *band, const uint32_t pixel,
+			  const uint32_t mask, const uint32_t start, const uint32_t end);
+};
+
 /**
  * struct display_info - framebuffer display information structure
  *
@@ -161,8 +364,17 @@ uint8_t sat_add(uint8_t to, uint8_t val)
  * @xres:		current resolution along the X-axis of the framebuffer
  * @yres:		current resolution along the Y-axis of the framebuffer
  * @bpp:		current bytes per pixel of the framebuffer
+ * @format:		pixel format of the framebuffer
+ * @masks:		packed input mask of every intensity, see pixel_pack()
  * @fb_len:		number of bytes of the current framebuffer
  * @line_length:	the length, in bytes, of a line of the current framebuffer
+ * @offset:		byte offset of the visible area within @fb, when copying
+ * @frame_len:		number of bytes spanned by the visible area
+ * @var_info:		variable screen information, used to pan the display
+ * @ypanstep:		granularity of panning along the Y-axis, 0 if unsupported
+ * @pages:		number of pages used for page flipping, 1 when copying
+ * @page:		page currently being displayed
+ * @vsync:		whether the driver supports FBIO_WAITFORVSYNC
  */
 struct display_info {
 	int fb_dev;
@@ -171,8 +383,85 @@ struct display_info {
 	uint32_t xres;
 	uint32_t yres;
 	uint8_t bpp;
+	const struct pixel_format *format;
+	uint32_t masks[UINT8_MAX + 1];
 	size_t fb_len;
 	uint32_t line_length;
+	size_t offset;
+	size_t frame_len;
+	struct fb_var_screeninfo var_info;
+	uint16_t ypanstep;
+	uint32_t pages;
+	uint32_t page;
+	bool vsync;
+};
+
+/**
+ * struct disp_geometry - memory layout of a virtual display
+ *
+ * @xres:		resolution along the X-axis
+ * @yres:		resolution along the Y-axis
+ * @format:		pixel format
+ * @line_length:	the length, in bytes, of a line
+ */
+struct disp_geometry {
+	uint32_t xres;
+	uint32_t yres;
+	const struct pixel_format *format;
+	uint32_t line_length;
+};
+
+/**
+ * struct options - command line options
+ *
+ * @abort:	abort if touch test is ok
+ * @analyse:	analyse the input device instead of running the touch test
+ * @banding:	enable banding of the background test pattern
+ * @lock:	lock the render buffers into memory
+ * @realtime:	SCHED_FIFO priority to run at, 0 to keep the default scheduling
+ * @cpus:	CPUs to run on, empty to run on any
+ * @fbpath:	framebuffer device, or file backing the virtual display, or NULL
+ * @evpath:	input event device or NULL
+ * @script:	input script to run instead of reading an input device, or NULL
+ * @record:	input log to record the input events to, or NULL
+ * @replay:	input log to replay instead of reading an input device, or NULL
+ * @speed:	factor to speed up the replay with, 0 to replay without delays
+ * @sysfs:	root of the sysfs tree to probe the devices with
+ * @coverage:	CSV file to write the coverage of every cell to, or NULL
+ * @stations:	display and touch screen pairs to test, see station_parse()
+ * @station_count:	number of elements in @stations, 0 to test @fbpath and @evpath
+ * @start:	monotonic time in ns the program started at
+ * @xsize:	size along the X-axis for the test pattern
+ * @ysize:	size along the Y-axis for the test pattern
+ * @fade:	speed of fade (decay) of the test pattern
+ * @framerate:	framerate in Hz to render at
+ * @threads:	number of threads to render frames with
+ * @virt:	geometry of the virtual display, all zero to use a framebuffer
+ */
+struct options {
+	bool abort;
+	bool analyse;
+	bool banding;
+	bool lock;
+	uint32_t realtime;
+	cpu_set_t cpus;
+	char *fbpath;
+	char *evpath;
+	char *script;
+	char *record;
+	char *replay;
+	double speed;
+	char *sysfs;
+	char *coverage;
+	char *stations[STATION_MAX];
+	uint32_t station_count;
+	uint64_t start;
+	uint32_t xsize;
+	uint32_t ysize;
+	uint32_t fade;
+	uint32_t framerate;
+	uint32_t threads;
+	struct disp_geometry virt;
 };
 
 /**
@@ -191,18 +480,42 @@ static void version(void)
 static void usage(char *argv0)
 {
 	printf("Usage: %s [OPTION] ... [<fb_dev> [<ev_dev>]]\n"
+	       "       %s --analyse-input [OPTION] ... [<ev_dev>]\n"
 	       "  -a, --abort				abort touch test ok\n"
+	       "  -A, --analyse-input			analyse report rate, noise and stuck touches of <ev_dev>\n"
 	       "  -e, --evdev=<event_dev>		force event device <ev_dev>\n"
 	       "  -f, --fbdev=<fb_dev>			force framebuffer device <fb_dev>\n"
 	       "  -t, --touchsize=<X[xY]>		input size X x Y of test pattern (default %ux%u)\n"
 	       "  -s, --fadespeed=<speed>		input fadeout speed (default %u)\n"
+	       "  -r, --framerate=<fps>			target framerate in Hz (default %u)\n"
 	       "  -b, --banding				enable banding of the background\n"
+	       "  -j, --threads=<N>			render frames in N stripes in parallel (default %u)\n"
+	       "  -L, --lock-memory			lock the render buffers into memory\n"
+	       "  -T, --realtime[=<prio>]		run at SCHED_FIFO priority <prio> with all memory locked (default %u)\n"
+	       "  -c, --cpus=<list>			run on the CPUs in <list> only (0,2-3 for example)\n"
+	       "  -V, --virtual-fb=<geometry>		render to a virtual display, backed by file <fb_dev> if supplied\n"
+	       "  -S, --script=<file>			generate input from script <file> instead of <ev_dev>\n"
+	       "  -w, --record=<file>			record the input events to log <file>\n"
+	       "  -R, --replay=<file>			replay the input events of log <file> instead of <ev_dev>\n"
+	       "  -X, --replay-speed=<factor|max>	replay <factor> times as fast, or without delays (default 1)\n"
+	       "  -y, --sysfs=<dir>			probe the devices through sysfs tree <dir> (default " SYSFS_ROOT ")\n"
+	       "  -C, --coverage=<file>			write the touches of every cell to CSV <file> when finished\n"
+	       "  -P, --station=<station>		test <station>, repeat to test several at once\n"
 	       "  -v, --version				display program version and exit\n"
 	       "  -h, --help				display this help and exit\n"
 	       "\n"
 	       "  fb_dev: Framebuffer device node (/dev/fb0 for example)\n"
-	       "  event_dev:  Event device node (/dev/input/event0 for example)\n",
-	       argv0, INPUT_DEFAULT_XSIZE, INPUT_DEFAULT_YSIZE, INPUT_DEFAULT_FADE);
+	       "  event_dev:  Event device node (/dev/input/event0 for example)\n"
+	       "  geometry: <X>x<Y>[x<bpp|format>][,<line_length>] of a virtual display (800x480x16 or\n"
+	       "            800x480xBGR565 for example), format one of XRGB8888, ARGB8888, RGB888,\n"
+	       "            RGB565 or BGR565\n"
+	       "  station: <fb_dev>[,<ev_dev|phys|uniq>] pairs a display with a touch screen, found by\n"
+	       "           its event device, phys location or uniq identifier, or the first one free\n"
+	       "\n"
+	       "Exits with failure unless every station touched every cell of the test pattern without\n"
+	       "losing its touch screen. Several stations are flipped without waiting for vsync.\n",
+	       argv0, argv0, INPUT_DEFAULT_XSIZE, INPUT_DEFAULT_YSIZE, INPUT_DEFAULT_FADE,
+	       DISPLAY_DEFAULT_FRAME_RATE, RENDER_DEFAULT_THREADS, REALTIME_DEFAULT_PRIORITY);
 }
 
 /**
@@ -231,413 +544,5457 @@ static struct color {
 
 
 /**
- * band_pixel() - perform line banding on the background
- *
- * @line_length:	visible length of a line
- * @addr:		address of the pixel (e.g. x*y*bpp)
- * @color:		color index of the background to band with
- * @red:		red color component to band
- * @green:		green color component to band
- * @blue:		blue color component to band
+ * fade_scalar() - reference kernel to fade (decay) a span of intensities
  *
- * If a display cannot show all colors properly an effect called banding
- * becomes visible. Two common examples is low bit-depth displays and broken
- * driver lines to the display. In both cases, colors do not have a smooth
- * gradient, but snap from one color to the next.
+ * @buf:	span to fade
+ * @len:	length, in bytes, of @buf
+ * @speed:	value to saturating subtract from every byte
+ */
+static void fade_scalar(uint8_t *buf, size_t len, const uint8_t speed)
+{
+	while (len--)
+		buf[len] = sat_sub(buf[len], speed);
+}
+
+/**
+ * fill_scalar() - reference kernel to fill a span with a single pixel
  *
- * This function will smooth course of the pixel over the length of the line
- * by splitting the line up in small bands where each band moves to the next
- * gradient.
+ * @dst:	destination span to fill
+ * @pixel:	packed pixel pattern, see pixel_pack()
+ * @len:	length, in bytes, of @dst, a multiple of DISPLAY_MIN_BPP
  *
- * For example, with a band_width of 3 pixels on a line of total 9 pixels we get
- * | rgb rgb rgb | rgb-1 rgb-1 rgb-1 | rgb-2 rgb-2 rgb-2 |
- * | rgb rgb rgb | rgb-1 rgb-1 rgb-1 | rgb-2 rgb-2 rgb-2 |
+ * The 32 bit pattern is repeated from the start of @dst onwards, which holds
+ * whole pixels of both 16 and 32 bit formats.
  */
-static inline void band_pixel(const uint32_t line_length, const uint32_t addr, const uint8_t color,
-			      uint8_t *red, uint8_t *green, uint8_t *blue)
+static void fill_scalar(uint8_t *dst, const uint32_t pixel, const size_t len)
 {
-	static uint8_t band = UINT8_MAX;
-	uint32_t band_width = (line_length / UINT8_MAX);
+	size_t i;
 
-	/*
-	 * Dragons be here. To accomplish banding we need to fade
-	 * each line from 0 - background_colors[]. This is easily
-	 * done by just subtracting the banding factor from the actual
-	 * color up until the color is reached.
-	 *
-	 * Because the modulus will match on the very first line,
-	 * we have to deal with a pre-mature addition. To work around
-	 * that we start the band at '-1'. But to ensure our band does
-	 * not do the addition after the reset, the order here matters.
-	 */
-	if ((addr % band_width) == 0)
-		band = sat_add(band, 1);
-	if ((addr % line_length) == 0)
-		band = 0;
-
-	*red   = sat_sub(background_colors[color].r, band);
-	*green = sat_sub(background_colors[color].g, band);
-	*blue  = sat_sub(background_colors[color].b, band);
+	for (i = 0; (i + sizeof(pixel)) <= len; i += sizeof(pixel))
+		memcpy(dst + i, &pixel, sizeof(pixel));
+	memcpy(dst + i, &pixel, len - i);
 }
 
 /**
- * background_draw() - render the background with input events
+ * fill_line_scalar() - reference kernel to invert a single pixel onto a line
  *
- * @buffer:	buffer to render the background and input events onto
- * @mask:	mask buffer to render input events into
- * @disp:	pointer to a valid and initialized display_info struct
- * @colorize:	indicator whether to change the background color
- *
- * This function combines a (predefined static) background color from
- * @background_colors and the input mask buffer. The combining operation is
- * to invert the mask onto the background.
+ * @dst:	destination span to fill
+ * @line:	span of background pixels
+ * @mask:	packed pixel pattern to invert onto every pixel of @line
+ * @len:	length, in bytes, of @dst and @line, a multiple of
+ *		DISPLAY_MIN_BPP
  *
- * Note that it is currently assumed that there is no virtual space beyond
- * the xres and yres.
- *
- * Note that the @buffer and @mask buffer need to be the same size as the
- * framebuffer (e.g. fb_len as size for both).
+ * As @mask holds no bits outside of the color channels, the padding and alpha
+ * bits of @line are kept as they are.
  */
-static void background_draw(uint8_t *buffer, const uint8_t *mask, struct display_info *disp, const bool banding, const bool colorize)
+static void fill_line_scalar(uint8_t *dst, const uint8_t *line, const uint32_t mask, const size_t len)
 {
-	static uint8_t c = 0;
-	uint32_t i = 0;
-
-	for (i = 0; i < disp->fb_len; i += disp->bpp) {
-		uint8_t r = background_colors[c].r;
-		uint8_t g = background_colors[c].g;
-		uint8_t b = background_colors[c].b;
-
-		if (banding)
-			band_pixel(disp->line_length, i, c, &r, &g, &b);
-
-		buffer[i + CHAN_R] = r ^ mask[i + CHAN_R];
-		buffer[i + CHAN_G] = g ^ mask[i + CHAN_G];
-		buffer[i + CHAN_B] = b ^ mask[i + CHAN_B];
-		buffer[i + CHAN_A] = 0x00;
-	}
+	uint8_t m[sizeof(mask)];
+	size_t i;
 
-	if (colorize) {
-		c++;
-		c %= ARRAY_SIZE(background_colors);
-	}
+	memcpy(m, &mask, sizeof(m));
+	for (i = 0; i < len; i++)
+		dst[i] = line[i] ^ m[i % sizeof(m)];
 }
 
 /**
- * input_matrix_check() - check whether all grid coordinates where activated
+ * store_head() - get the number of bytes to store up to an aligned address
  *
- * @matrix:		input verification matrix
- * @matrix_size:	number of elements in @matrix
+ * @dst:	destination of the stores
+ * @align:	alignment to reach, a power of two
+ * @len:	number of bytes to store
  *
- * Checks if all rectangles in the @matrix have been activated. When so, print
- * this to stdout and reset the matrix.
+ * The vector kernels store the head up to the first aligned address one by
+ * one and the rest in full, aligned vectors. The framebuffer is usually
+ * mapped write-combined, where partial or misaligned stores break up the
+ * bursts to the display memory.
  *
- * Return:		true if all elements where activated, false otherwise.
+ * Return:	the number of bytes before the first @align aligned address,
+ *		at most @len.
  */
-static bool input_matrix_check(bool *matrix, const size_t matrix_size)
+static inline size_t store_head(const uint8_t *dst, const size_t align, const size_t len)
 {
-	size_t size = matrix_size;
-
-	while (--size) {
-		if (!matrix[size])
-			return false;
-	}
+	size_t head = -(uintptr_t)dst & (align - 1);
 
-	puts("Input test: success");
-	memset(matrix, false, matrix_size);
-
-	return true;
+	return (head < len) ? head : len;
 }
 
 /**
- * input_mark() - mark received input events
+ * pattern_rotate() - advance a packed pixel pattern
  *
- * @mask:	mask buffer to render input events into
- * @matrix:	input matrix buffer to mark input events into
- * @disp:	pointer to a valid and initialized display_info struct
- * @x:		x coordinate of input event to render
- * @y:		y coordinate of input event to render
- * @xsize:	size along the X-axis for the test pattern
- * @ysize:	size along the Y-axis for the test pattern
- *
- * This function will render a test pattern as input event into @buffer of
- * size <xsize>x<ysize> clamped to those sizes, separated by a border of
- * TEST_PATTERN_BORDER size. For potential automatic test verification the
- * input event within the square grid is also stored in @matrix.
+ * @pattern:	packed pixel pattern, see pixel_pack()
+ * @bytes:	number of bytes to advance @pattern by
  *
- * Note that the @mask buffer needs to be the same size as the framebuffer.
+ * Return:	the pattern as it continues @bytes bytes after its start.
  */
-static void input_mark(uint8_t *mask, bool *matrix, const struct display_info *disp,
-		       int32_t x, int32_t y, uint32_t xsize, uint32_t ysize)
+static inline uint32_t pattern_rotate(const uint32_t pattern, const size_t bytes)
 {
-	uint32_t row = 0;
+	uint8_t p[2 * sizeof(pattern)];
+	uint32_t rotated;
 
-	x = clamp(x, xsize);
-	y = clamp(y, ysize);
+	memcpy(p, &pattern, sizeof(pattern));
+	memcpy(p + sizeof(pattern), &pattern, sizeof(pattern));
+	memcpy(&rotated, p + (bytes % sizeof(pattern)), sizeof(rotated));
 
-	row = (disp->line_length / disp->bpp / xsize);
-	matrix[(row * (y / ysize)) + (x / xsize)] = true;
+	return rotated;
+}
 
-	xsize -= TEST_PATTERN_BORDER;
-	ysize -= TEST_PATTERN_BORDER;
+#if defined(__x86_64__) || defined(__i386__)
+static bool sse2_supported(void)
+{
+	__builtin_cpu_init();
 
-	for (row = y; row < (y + ysize); row++) {
-		uint32_t col;
+	return __builtin_cpu_supports("sse2");
+}
 
-		for (col = x; col < (x + xsize); col++) {
-			uint32_t coord;
+__attribute__((target("sse2")))
+static void fade_sse2(uint8_t *buf, size_t len, const uint8_t speed)
+{
+	const __m128i sub = _mm_set1_epi8(speed);
+	size_t i = 0;
 
-			coord = (col * disp->bpp) + (row * disp->line_length);
-			if ((coord + 3) > disp->fb_len)
-				break;
+	for (; (i + sizeof(__m128i)) <= len; i += sizeof(__m128i)) {
+		__m128i v = _mm_loadu_si128((__m128i *)(buf + i));
 
-			mask[coord + CHAN_R] = UINT8_MAX;
-			mask[coord + CHAN_G] = UINT8_MAX;
-			mask[coord + CHAN_B] = UINT8_MAX;
-			mask[coord + CHAN_A] = 0x00;
-		}
+		_mm_storeu_si128((__m128i *)(buf + i), _mm_subs_epu8(v, sub));
 	}
+	fade_scalar(buf + i, len - i, speed);
 }
 
-/**
- * input_fade() - helper function to fade the input events away
- *
- * @mask:	mask buffer to render input events into
- * @mask_len:	size of mask buffer
- * @speed:	speed of fade (decay) of the test pattern
- *
- * Note that the mask buffer needs to be the same size as the framebuffer.
- *
- * Function to remove any input events using @speed as a sort of decay
- * speed.
- */
-static void input_fade(uint8_t *mask, size_t mask_len, uint8_t speed)
+__attribute__((target("sse2")))
+static void fill_sse2(uint8_t *dst, const uint32_t pixel, const size_t len)
 {
-	while (mask_len--)
-		mask[mask_len] = sat_sub(mask[mask_len], speed);
+	size_t i = store_head(dst, sizeof(__m128i), len);
+	const __m128i color = _mm_set1_epi32(pattern_rotate(pixel, i));
+
+	fill_scalar(dst, pixel, i);
+	for (; (i + sizeof(__m128i)) <= len; i += sizeof(__m128i))
+		_mm_store_si128((__m128i *)(dst + i), color);
+	fill_scalar(dst + i, pattern_rotate(pixel, i), len - i);
 }
 
-/**
- * renderloop() - main render loop and input handling
- *
- * @evdev:	pointer to a valid and initialized libevdev struct
- * @disp:	pointer to a valid, initialized and mmaped display_info struct
- * @xsize:	size along the X-axis for the test pattern
- * @ysize:	size along the Y-axis for the test pattern
- * @fade:	speed of fade (decay) of the test pattern
- * @banding:	enable banding of the background test pattern
- * @abort:	abort if touch test is ok
- *
- * This function takes the supplied parameters and uses these to render the
- * main application to @disp. The input itself is rendered into a buffer
- * and then inverts the main background. This so that the test pattern remains
- * visible after it has been asserted. In the mainloop a frame is copied from
- * the backbuffer to the framebuffer once every DISPLAY_FRAME_RATE. The rest
- * of the time is used to scan for input.
- *
- * Return:	0 on success, an error code otherwise.
- */
-static int renderloop(struct libevdev *evdev, struct display_info *disp,
-		      uint32_t xsize, uint32_t ysize, uint32_t fade,
-		      const bool banding, const bool abort)
+__attribute__((target("sse2")))
+static void fill_line_sse2(uint8_t *dst, const uint8_t *line, const uint32_t mask, const size_t len)
 {
-	bool frame_drawn = false;
-	bool update_input = false;
-	clock_t offset = 0;
-	size_t matrix_size = (disp->xres / xsize) * (disp->yres / ysize);
-	bool matrix[matrix_size];
-	uint32_t elapsed = 0;
-	uint8_t *backbuffer = NULL, *touchmask = NULL;
+	size_t i = store_head(dst, sizeof(__m128i), len);
+	const __m128i m = _mm_set1_epi32(pattern_rotate(mask, i));
 
-	memset(disp->fb, 0x00, disp->fb_len);
+	fill_line_scalar(dst, line, mask, i);
+	for (; (i + sizeof(__m128i)) <= len; i += sizeof(__m128i)) {
+		__m128i l = _mm_loadu_si128((const __m128i *)(line + i));
 
-	memset(matrix, false, matrix_size);
+		_mm_store_si128((__m128i *)(dst + i), _mm_xor_si128(l, m));
+	}
+	fill_line_scalar(dst + i, line + i, pattern_rotate(mask, i), len - i);
+}
 
-	backbuffer = (uint8_t *)calloc(disp->fb_len, sizeof(uint8_t));
-	if (!backbuffer)
-		return -ENOMEM;
+static bool avx2_supported(void)
+{
+	__builtin_cpu_init();
 
-	touchmask = (uint8_t *)calloc(disp->fb_len, sizeof(uint8_t));
-	if (!touchmask)
-		return -ENOMEM;
+	return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("avx2")))
+static void fade_avx2(uint8_t *buf, size_t len, const uint8_t speed)
+{
+	const __m256i sub = _mm256_set1_epi8(speed);
+	size_t i = 0;
 
-	offset = clock();
+	for (; (i + sizeof(__m256i)) <= len; i += sizeof(__m256i)) {
+		__m256i v = _mm256_loadu_si256((__m256i *)(buf + i));
 
-	while (!renderloop_stop) {
-		int next_event;
-		int x, y;
-		struct input_event event;
-		uint32_t msec;
+		_mm256_storeu_si256((__m256i *)(buf + i), _mm256_subs_epu8(v, sub));
+	}
+	fade_scalar(buf + i, len - i, speed);
+}
 
-		msec = (clock() - offset) * 1000 / CLOCKS_PER_SEC;
+__attribute__((target("avx2")))
+static void fill_avx2(uint8_t *dst, const uint32_t pixel, const size_t len)
+{
+	size_t i = store_head(dst, sizeof(__m256i), len);
+	const __m256i color = _mm256_set1_epi32(pattern_rotate(pixel, i));
 
-		next_event = libevdev_next_event(evdev, LIBEVDEV_READ_FLAG_NORMAL, &event);
-		if (next_event == LIBEVDEV_READ_STATUS_SUCCESS) {
-			libevdev_fetch_event_value(evdev, EV_ABS, ABS_X, &x);
-			libevdev_fetch_event_value(evdev, EV_ABS, ABS_Y, &y);
-			update_input = true;
-		}
+	fill_scalar(dst, pixel, i);
+	for (; (i + sizeof(__m256i)) <= len; i += sizeof(__m256i))
+		_mm256_store_si256((__m256i *)(dst + i), color);
+	fill_scalar(dst + i, pattern_rotate(pixel, i), len - i);
+}
 
-		if ((msec % FPS(DISPLAY_FRAME_RATE)) != 0) {
-			frame_drawn = false;
-		} else {
-			if (!frame_drawn) {
-				bool bg_cycle_color = (elapsed > DISPLAY_BG_CYCLE);
+__attribute__((target("avx2")))
+static void fill_line_avx2(uint8_t *dst, const uint8_t *line, const uint32_t mask, const size_t len)
+{
+	size_t i = store_head(dst, sizeof(__m256i), len);
+	const __m256i m = _mm256_set1_epi32(pattern_rotate(mask, i));
 
-				memcpy(disp->fb, backbuffer, disp->fb_len);
-				frame_drawn = true;
+	fill_line_scalar(dst, line, mask, i);
+	for (; (i + sizeof(__m256i)) <= len; i += sizeof(__m256i)) {
+		__m256i l = _mm256_loadu_si256((const __m256i *)(line + i));
 
-				input_fade(touchmask, disp->fb_len, fade);
+		_mm256_store_si256((__m256i *)(dst + i), _mm256_xor_si256(l, m));
+	}
+	fill_line_scalar(dst + i, line + i, pattern_rotate(mask, i), len - i);
+}
+#endif
 
-				background_draw(backbuffer, touchmask, disp, banding, bg_cycle_color);
+#if defined(__aarch64__) || defined(__arm__)
+#if defined(__aarch64__)
+#define NEON_TARGET
+static bool neon_supported(void)
+{
+	return true;
+}
+#else
+#define NEON_TARGET	__attribute__((target("fpu=neon")))
+static bool neon_supported(void)
+{
+	return !!(getauxval(AT_HWCAP) & HWCAP_ARM_NEON);
+}
+#endif
 
-				if (bg_cycle_color)
-					elapsed = 0;
-				else
-					elapsed++;
-			}
-			if (update_input) {
-				input_mark(touchmask, matrix, disp, x, y, xsize, ysize);
+NEON_TARGET
+static void fade_neon(uint8_t *buf, size_t len, const uint8_t speed)
+{
+	const uint8x16_t sub = vdupq_n_u8(speed);
+	size_t i = 0;
 
-				if (input_matrix_check(matrix, matrix_size) && abort)
-					break;
+	for (; (i + sizeof(uint8x16_t)) <= len; i += sizeof(uint8x16_t))
+		vst1q_u8(buf + i, vqsubq_u8(vld1q_u8(buf + i), sub));
+	fade_scalar(buf + i, len - i, speed);
+}
 
-				update_input = false;
-			}
-		}
-	}
+NEON_TARGET
+static void fill_neon(uint8_t *dst, const uint32_t pixel, const size_t len)
+{
+	size_t i = store_head(dst, sizeof(uint8x16_t), len);
+	const uint8x16_t color = vreinterpretq_u8_u32(vdupq_n_u32(pattern_rotate(pixel, i)));
 
-	free(backbuffer);
-	free(touchmask);
+	fill_scalar(dst, pixel, i);
+	for (; (i + sizeof(uint8x16_t)) <= len; i += sizeof(uint8x16_t))
+		vst1q_u8(dst + i, color);
+	fill_scalar(dst + i, pattern_rotate(pixel, i), len - i);
+}
 
-	printf("\nTest finished.\n");
+NEON_TARGET
+static void fill_line_neon(uint8_t *dst, const uint8_t *line, const uint32_t mask, const size_t len)
+{
+	size_t i = store_head(dst, sizeof(uint8x16_t), len);
+	const uint8x16_t m = vreinterpretq_u8_u32(vdupq_n_u32(pattern_rotate(mask, i)));
 
-	return 0;
+	fill_line_scalar(dst, line, mask, i);
+	for (; (i + sizeof(uint8x16_t)) <= len; i += sizeof(uint8x16_t))
+		vst1q_u8(dst + i, veorq_u8(vld1q_u8(line + i), m));
+	fill_line_scalar(dst + i, line + i, pattern_rotate(mask, i), len - i);
 }
+#endif
 
 /**
- * evdev_open() - open an input event device node
+ * struct render_kernel - set of compositing kernels for one instruction set
  *
- * @path:	required parameter to a event device node path
+ * @name:	name of the instruction set
+ * @supported:	runtime check whether the CPU supports the kernels, NULL if
+ *		always supported
+ * @fade:	kernel to fade (decay) a span of intensities, see fade_scalar()
+ * @fill:	kernel to fill a span with a single pixel, see fill_scalar()
+ * @fill_line:	kernel to invert a single pixel onto a line, see
+ *		fill_line_scalar()
+ */
+struct render_kernel {
+	const char *name;
+	bool (*supported)(void);
+	void (*fade)(uint8_t *buf, size_t len, const uint8_t speed);
+	void (*fill)(uint8_t *dst, const uint32_t pixel, const size_t len);
+	void (*fill_line)(uint8_t *dst, const uint8_t *line, const uint32_t mask, const size_t len);
+};
+
+/*
+ * Available kernels, in order of preference. The scalar kernels are the
+ * reference implementation and must always come last.
+ */
+static const struct render_kernel render_kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+	{ .name = "avx2", .supported = avx2_supported, .fade = fade_avx2, .fill = fill_avx2,
+	  .fill_line = fill_line_avx2 },
+	{ .name = "sse2", .supported = sse2_supported, .fade = fade_sse2, .fill = fill_sse2,
+	  .fill_line = fill_line_sse2 },
+#endif
+#if defined(__aarch64__) || defined(__arm__)
+	{ .name = "neon", .supported = neon_supported, .fade = fade_neon, .fill = fill_neon,
+	  .fill_line = fill_line_neon },
+#endif
+	{ .name = "scalar", .supported = NULL, .fade = fade_scalar, .fill = fill_scalar,
+	  .fill_line = fill_line_scalar },
+};
+
+static const struct render_kernel *kernel = &render_kernels[ARRAY_SIZE(render_kernels) - 1];
+
+#define KERNEL_CHECK_LEN	256
+#define KERNEL_CHECK_ALIGN	32
+
+/**
+ * render_kernel_check() - verify a kernel against the scalar reference
  *
- * Note that the caller is responsible for calling libedev_free() when done
- * using the returned device pointer.
+ * @k:	kernel to verify
  *
- * Return:	a valid pointer to a libevdev structure on success, NULL otherwise.
+ * Runs both kernels over a pseudo random pattern with every combination of
+ * fade speed, misalignment and (short) length, so that the vector body as
+ * well as the scalar heads and tails get exercised.
+ *
+ * Return:	true if @k yields bit identical output, false otherwise.
  */
-static struct libevdev *evdev_open(const char *path)
+static bool render_kernel_check(const struct render_kernel *k)
 {
-	struct libevdev *evdev = NULL;
-	int ret = -1;
-	int fd = -1;
+	const struct render_kernel *ref = &render_kernels[ARRAY_SIZE(render_kernels) - 1];
+	uint8_t src[KERNEL_CHECK_LEN + KERNEL_CHECK_ALIGN + INPUT_MAX_FADE];
+	uint8_t exp[KERNEL_CHECK_LEN + KERNEL_CHECK_ALIGN] __attribute__((aligned(KERNEL_CHECK_ALIGN)));
+	uint8_t res[KERNEL_CHECK_LEN + KERNEL_CHECK_ALIGN] __attribute__((aligned(KERNEL_CHECK_ALIGN)));
+	uint32_t seed = 0x12345678;
+	uint32_t pixel = 0x00a55aff;
+	unsigned int speed;
+	size_t i;
 
-	fd = open(path, O_RDONLY | O_NONBLOCK);
-	if (fd < 0) {
-		fprintf(stderr, "Unable to open '%s': %s\n", path, strerror(errno));
-		return NULL;
+	for (i = 0; i < sizeof(src); i++) {
+		seed = (seed * 1103515245) + 12345;
+		src[i] = seed >> 16;
 	}
 
-	ret = libevdev_new_from_fd(fd, &evdev);
-	if (ret) {
-		fprintf(stderr, "Failed to create evdev for '%s': %s\n", path, strerror(ret));
-		close(fd);
-	}
+	for (speed = 0; speed <= INPUT_MAX_FADE; speed++) {
+		size_t offset;
 
-	return evdev;
-}
+		for (offset = 0; offset < KERNEL_CHECK_ALIGN; offset++) {
+			size_t len;
 
-/**
- * is_event_device - scandir helper to find an event device
+			for (len = 0; len <= KERNEL_CHECK_LEN; len += (len < 64) ? 1 : 61) {
+				memcpy(exp, src, sizeof(exp));
+				memcpy(res, src, sizeof(res));
+				ref->fade(exp + offset, len, speed);
+				k->fade(res + offset, len, speed);
+				if (memcmp(exp, res, sizeof(exp)))
+					return false;
+
+				if (len % DISPLAY_MIN_BPP)
+					continue;
+
+				memset(exp, 0, sizeof(exp));
+				memset(res, 0, sizeof(res));
+				ref->fill(exp + offset, pixel ^ speed, len);
+				k->fill(res + offset, pixel ^ speed, len);
+				if (memcmp(exp, res, sizeof(exp)))
+					return false;
+
+				ref->fill_line(exp + offset, src + speed, pixel ^ speed, len);
+				k->fill_line(res + offset, src + speed, pixel ^ speed, len);
+				if (memcmp(exp, res, sizeof(exp)))
+					return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/**
+ * render_kernel_select() - select the fastest working compositing kernels
+ *
+ * Every kernel that the CPU supports is verified against the scalar reference
+ * kernels first. Kernels that do not yield identical output are skipped.
+ */
+static void render_kernel_select(void)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(render_kernels); i++) {
+		const struct render_kernel *k = &render_kernels[i];
+
+		if (k->supported && !k->supported())
+			continue;
+
+		if (!render_kernel_check(k)) {
+			fprintf(stderr, "Skipping render kernel '%s', self-check failed.\n", k->name);
+			continue;
+		}
+
+		kernel = k;
+		break;
+	}
+
+	printf("Render kernel: %s\n", kernel->name);
+}
+
+/**
+ * PIXEL_SPAN() - define the span renderers for pixels that tile 32 bits
+ *
+ * @__bits:	bits per pixel, 16 or 32
+ *
+ * The packed pattern of such pixels holds whole pixels, so spans of them are
+ * rendered by the compositing kernels directly. span_draw<bits>() fills the
+ * span with the background color and ignores @band, span_band<bits>() inverts
+ * the mask onto the banded line @band and ignores @pixel.
+ */
+#define PIXEL_SPAN(__bits) \
+static void span_draw##__bits(uint8_t *line, const uint8_t *band, const uint32_t pixel, \
+			      const uint32_t mask, const uint32_t start, const uint32_t end) \
+{ \
+	const size_t bpp = (__bits) / CHAR_BIT; \
+ \
+	kernel->fill(line + (start * bpp), pixel ^ mask, (end - start) * bpp); \
+} \
+ \
+static void span_band##__bits(uint8_t *line, const uint8_t *band, const uint32_t pixel, \
+			      const uint32_t mask, const uint32_t start, const uint32_t end) \
+{ \
+	const size_t bpp = (__bits) / CHAR_BIT; \
+ \
+	kernel->fill_line(line + (start * bpp), band + (start * bpp), mask, (end - start) * bpp); \
+}
+
+PIXEL_SPAN(16)
+PIXEL_SPAN(32)
+
+/**
+ * span_draw24() - render a span of 24 bit pixels
+ *
+ * @line:	line of the buffer to render into
+ * @band:	unused, see span_band24()
+ * @pixel:	packed background color, see pixel_pack()
+ * @mask:	packed input mask to invert onto the background
+ * @start:	first pixel of the span
+ * @end:	first pixel after the span
+ *
+ * 24 bit pixels do not tile the 32 bit pattern of the compositing kernels, so
+ * these are stored byte by byte.
+ */
+static void span_draw24(uint8_t *line, const uint8_t *band, const uint32_t pixel,
+			const uint32_t mask, const uint32_t start, const uint32_t end)
+{
+	uint32_t color = pixel ^ mask;
+	uint8_t p[sizeof(color)];
+	uint32_t i;
+
+	memcpy(p, &color, sizeof(p));
+	for (i = start * 3; i < (end * 3); i += 3) {
+		line[i + 0] = p[0];
+		line[i + 1] = p[1];
+		line[i + 2] = p[2];
+	}
+}
+
+/**
+ * span_band24() - render a span of 24 bit pixels onto a banded line
+ *
+ * @line:	line of the buffer to render into
+ * @band:	banded line of the background color
+ * @pixel:	unused, see span_draw24()
+ * @mask:	packed input mask to invert onto the background
+ * @start:	first pixel of the span
+ * @end:	first pixel after the span
+ */
+static void span_band24(uint8_t *line, const uint8_t *band, const uint32_t pixel,
+			const uint32_t mask, const uint32_t start, const uint32_t end)
+{
+	uint8_t m[sizeof(mask)];
+	uint32_t i;
+
+	memcpy(m, &mask, sizeof(m));
+	for (i = start * 3; i < (end * 3); i += 3) {
+		line[i + 0] = band[i + 0] ^ m[0];
+		line[i + 1] = band[i + 1] ^ m[1];
+		line[i + 2] = band[i + 2] ^ m[2];
+	}
+}
+
+/*
+ * Supported pixel formats. Where a driver does not describe its bitfields,
+ * the first format of its depth is assumed.
+ */
+static const struct pixel_format pixel_formats[] = {
+	{ .name = "XRGB8888", .bpp = 4, .span = span_draw32, .span_band = span_band32,
+	  .red = { .offset = 16, .length = 8 }, .green = { .offset = 8, .length = 8 },
+	  .blue = { .offset = 0, .length = 8 }, .transp = { .offset = 0, .length = 0 } },
+	{ .name = "ARGB8888", .bpp = 4, .span = span_draw32, .span_band = span_band32,
+	  .red = { .offset = 16, .length = 8 }, .green = { .offset = 8, .length = 8 },
+	  .blue = { .offset = 0, .length = 8 }, .transp = { .offset = 24, .length = 8 } },
+	{ .name = "RGB888", .bpp = 3, .span = span_draw24, .span_band = span_band24,
+	  .red = { .offset = 16, .length = 8 }, .green = { .offset = 8, .length = 8 },
+	  .blue = { .offset = 0, .length = 8 }, .transp = { .offset = 0, .length = 0 } },
+	{ .name = "RGB565", .bpp = 2, .span = span_draw16, .span_band = span_band16,
+	  .red = { .offset = 11, .length = 5 }, .green = { .offset = 5, .length = 6 },
+	  .blue = { .offset = 0, .length = 5 }, .transp = { .offset = 0, .length = 0 } },
+	{ .name = "BGR565", .bpp = 2, .span = span_draw16, .span_band = span_band16,
+	  .red = { .offset = 0, .length = 5 }, .green = { .offset = 5, .length = 6 },
+	  .blue = { .offset = 11, .length = 5 }, .transp = { .offset = 0, .length = 0 } },
+};
+
+/**
+ * bitfield_equal() - compare two bitfields of a pixel
+ *
+ * @a:	bitfield to compare
+ * @b:	bitfield to compare against
+ *
+ * Drivers may report any offset for a channel they do not have, such as the
+ * alpha channel of XRGB8888, so absent channels always compare equal.
+ *
+ * Return:	true if both describe the same bits, or both are absent.
+ */
+static inline bool bitfield_equal(const struct fb_bitfield *a, const struct fb_bitfield *b)
+{
+	if (a->length != b->length)
+		return false;
+
+	return !a->length || ((a->offset == b->offset) && (a->msb_right == b->msb_right));
+}
+
+/**
+ * pixel_format_find() - find the pixel format of a framebuffer
+ *
+ * @var_info:	variable screen information of the framebuffer
+ *
+ * Return:	the matching pixel format, NULL if unsupported.
+ */
+static const struct pixel_format *pixel_format_find(const struct fb_var_screeninfo *var_info)
+{
+	bool described = var_info->red.length || var_info->green.length || var_info->blue.length;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(pixel_formats); i++) {
+		const struct pixel_format *format = &pixel_formats[i];
+
+		if ((format->bpp * CHAR_BIT) != var_info->bits_per_pixel)
+			continue;
+
+		if (!described ||
+		    (bitfield_equal(&format->red, &var_info->red) &&
+		     bitfield_equal(&format->green, &var_info->green) &&
+		     bitfield_equal(&format->blue, &var_info->blue) &&
+		     bitfield_equal(&format->transp, &var_info->transp)))
+			return format;
+	}
+
+	return NULL;
+}
+
+/**
+ * pixel_channel() - scale an 8-bit color component into a bitfield
+ *
+ * @val:	8-bit color component
+ * @field:	bitfield of the channel, at most 8 bits long
+ *
+ * Return:	the component, truncated to and placed at @field.
+ */
+static inline uint32_t pixel_channel(const uint8_t val, const struct fb_bitfield *field)
+{
+	if (!field->length)
+		return 0;
+
+	return (uint32_t)(val >> (CHAR_BIT - field->length)) << field->offset;
+}
+
+/**
+ * pixel_pack() - pack color components into a pattern of native pixels
+ *
+ * @format:	pixel format to pack into
+ * @r:		8-bit red component
+ * @g:		8-bit green component
+ * @b:		8-bit blue component
+ *
+ * The alpha channel, if any, is set to opaque. 16 bit pixels are repeated to
+ * fill the pattern, 24 bit pixels occupy its first three bytes.
+ *
+ * Because channels are truncated, inverting a packed pixel with a packed mask
+ * equals packing the inverted components, so masks can be applied packed.
+ *
+ * Return:	32-bit pattern as laid out in memory.
+ */
+static uint32_t pixel_pack(const struct pixel_format *format, const uint8_t r,
+			   const uint8_t g, const uint8_t b)
+{
+	uint32_t value = pixel_channel(r, &format->red) |
+			 pixel_channel(g, &format->green) |
+			 pixel_channel(b, &format->blue) |
+			 pixel_channel(UINT8_MAX, &format->transp);
+	uint8_t p[sizeof(value)] = { 0 };
+	uint16_t half = value;
+	uint32_t pattern;
+	size_t i;
+
+	switch (format->bpp) {
+	case sizeof(uint16_t):
+		memcpy(p, &half, sizeof(half));
+		memcpy(p + sizeof(half), &half, sizeof(half));
+		break;
+	case sizeof(uint32_t):
+		memcpy(p, &value, sizeof(value));
+		break;
+	default:
+		/* packed 24 bit pixels are stored least significant byte first */
+		for (i = 0; i < format->bpp; i++)
+			p[i] = value >> (i * CHAR_BIT);
+		break;
+	}
+	memcpy(&pattern, p, sizeof(pattern));
+
+	return pattern;
+}
+
+/**
+ * disp_format_set() - set up rendering for the pixel format of a display
+ *
+ * @disp:	pointer to a valid display_info struct
+ * @format:	pixel format of the display
+ *
+ * The input mask of every intensity is packed up front, so rendering never
+ * has to deal with the individual channels.
+ */
+static void disp_format_set(struct display_info *disp, const struct pixel_format *format)
+{
+	uint32_t black = pixel_pack(format, 0x00, 0x00, 0x00);
+	unsigned int level;
+
+	disp->format = format;
+	disp->bpp = format->bpp;
+	for (level = 0; level <= UINT8_MAX; level++)
+		disp->masks[level] = pixel_pack(format, level, level, level) ^ black;
+}
+
+/**
+ * struct arena - buffer arena the render path is carved from
+ *
+ * @base:	start of the arena, NULL if not allocated
+ * @size:	size of the arena in bytes
+ * @used:	number of bytes handed out
+ *
+ * All buffers used while rendering are allocated from a single arena up front,
+ * so that none is faulted in during the first frames, every buffer starts on a
+ * cache line and all are released at once by arena_free().
+ */
+struct arena {
+	uint8_t *base;
+	size_t size;
+	size_t used;
+};
+
+/**
+ * arena_init() - allocate a pre-faulted buffer arena
+ *
+ * @arena:	arena structure to initialize
+ * @size:	size of the arena in bytes, see ARENA_SIZE()
+ * @lock:	lock the arena into memory
+ *
+ * Arenas of at least ARENA_HUGE_PAGE are backed by huge pages if the system
+ * has any reserved, and are otherwise advised to be backed by transparent huge
+ * pages. All pages are populated before returning. Failing to lock the arena
+ * into memory, for example due to RLIMIT_MEMLOCK, is not fatal.
+ *
+ * Note that the caller is responsible for calling arena_free() when done.
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int arena_init(struct arena *arena, size_t size, const bool lock)
+{
+	const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE;
+	size_t page = sysconf(_SC_PAGESIZE);
+	void *base = MAP_FAILED;
+
+	memset(arena, 0, sizeof(*arena));
+	if (size >= ARENA_HUGE_PAGE) {
+		size = (size + ARENA_HUGE_PAGE - 1) & ~(ARENA_HUGE_PAGE - 1);
+		base = mmap(NULL, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+	} else {
+		size = (size + page - 1) & ~(page - 1);
+	}
+	if (base == MAP_FAILED) {
+		base = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+		if (base == MAP_FAILED) {
+			int err = errno;
+
+			fprintf(stderr, "Unable to allocate render buffers: %s\n", strerror(err));
+			return -err;
+		}
+		if (size >= ARENA_HUGE_PAGE)
+			madvise(base, size, MADV_HUGEPAGE);
+	}
+
+	if (lock && mlock(base, size))
+		fprintf(stderr, "Unable to lock render buffers into memory: %s\n", strerror(errno));
+
+	arena->base = base;
+	arena->size = size;
+
+	return 0;
+}
+
+/**
+ * arena_alloc() - carve a zeroed buffer from an arena
+ *
+ * @arena:	pointer to a valid and initialized arena struct
+ * @len:	length of the buffer in bytes
+ *
+ * Return:	buffer aligned to ARENA_ALIGN on success, NULL if @arena is full.
+ */
+static void *arena_alloc(struct arena *arena, const size_t len)
+{
+	void *buf;
+
+	if (ARENA_SIZE(len) > (arena->size - arena->used))
+		return NULL;
+
+	buf = arena->base + arena->used;
+	arena->used += ARENA_SIZE(len);
+
+	return buf;
+}
+
+/**
+ * arena_free() - release an arena and all buffers carved from it
+ *
+ * @arena:	arena structure to clean up
+ */
+static void arena_free(struct arena *arena)
+{
+	if (arena->base)
+		munmap(arena->base, arena->size);
+	memset(arena, 0, sizeof(*arena));
+}
+
+/**
+ * band_lines_size() - get the space the banded lines take up in an arena
+ *
+ * @disp:	pointer to a valid and initialized display_info struct
+ *
+ * Return:	size in bytes to reserve for band_lines_init().
+ */
+static size_t band_lines_size(const struct display_info *disp)
+{
+	return ARENA_SIZE(ARRAY_SIZE(background_colors) * disp->line_length);
+}
+
+/**
+ * band_lines_init() - precompute the banded lines of all background colors
+ *
+ * @disp:	pointer to a valid and initialized display_info struct
+ * @arena:	arena to allocate the lines from
+ *
+ * If a display cannot show all colors properly an effect called banding
+ * becomes visible. Two common examples is low bit-depth displays and broken
+ * driver lines to the display. In both cases, colors do not have a smooth
+ * gradient, but snap from one color to the next.
+ *
+ * To show this, each line is split up in small bands where each band moves to
+ * the next gradient, fading each line from background_colors[] towards 0.
+ *
+ * For example, with a band_width of 3 pixels on a line of total 9 pixels we get
+ * | rgb rgb rgb | rgb-1 rgb-1 rgb-1 | rgb-2 rgb-2 rgb-2 |
+ * | rgb rgb rgb | rgb-1 rgb-1 rgb-1 | rgb-2 rgb-2 rgb-2 |
+ *
+ * As every line of the background is identical, a single line is rendered per
+ * background color, which is then combined with every row of the input mask.
+ * The line of color c starts at c * line_length.
+ *
+ * Return:	buffer holding all banded lines on success, NULL otherwise.
+ */
+static uint8_t *band_lines_init(const struct display_info *disp, struct arena *arena)
+{
+	uint32_t band_width = (disp->line_length / UINT8_MAX);
+	uint8_t *lines;
+	size_t c;
+
+	if (band_width == 0)
+		band_width = 1;
+
+	lines = arena_alloc(arena, ARRAY_SIZE(background_colors) * disp->line_length);
+	if (!lines)
+		return NULL;
+
+	for (c = 0; c < ARRAY_SIZE(background_colors); c++) {
+		uint8_t *line = lines + (c * disp->line_length);
+		uint32_t i;
+
+		for (i = 0; i < (disp->xres * disp->bpp); i += disp->bpp) {
+			uint32_t band = i / band_width;
+			uint32_t pixel;
+
+			if (band > UINT8_MAX)
+				band = UINT8_MAX;
+
+			pixel = pixel_pack(disp->format,
+					   sat_sub(background_colors[c].r, band),
+					   sat_sub(background_colors[c].g, band),
+					   sat_sub(background_colors[c].b, band));
+			memcpy(line + i, &pixel, disp->bpp);
+		}
+	}
+
+	return lines;
+}
+
+/**
+ * struct render_pipeline - render variant selected for a color and settings
+ *
+ * @span:	span renderer of the pixel format, banded or not
+ * @band:	banded line of the background color, NULL if not banding
+ * @pixel:	packed background color, see pixel_pack()
+ * @fade:	speed of fade (decay) of the test pattern, 0 to never fade
+ *
+ * Everything that depends only on the background color and the command line
+ * options is resolved once by render_pipeline_select(), so that rendering a
+ * span never has to check whether banding or fading is enabled.
+ */
+struct render_pipeline {
+	void (*span)(uint8_t *line, const uint8_t *band, const uint32_t pixel,
+		     const uint32_t mask, const uint32_t start, const uint32_t end);
+	const uint8_t *band;
+	uint32_t pixel;
+	uint8_t fade;
+};
+
+/**
+ * render_pipeline_select() - select the render variant for a background color
+ *
+ * @pipe:	render_pipeline structure to set up
+ * @disp:	pointer to a valid and initialized display_info struct
+ * @bands:	banded lines from band_lines_init(), NULL to disable banding
+ * @color:	index of the background color in @background_colors
+ * @fade:	speed of fade (decay) of the test pattern
+ *
+ * Must be called again whenever the background color changes.
+ */
+static void render_pipeline_select(struct render_pipeline *pipe, const struct display_info *disp,
+				   const uint8_t *bands, const uint8_t color, const uint8_t fade)
+{
+	pipe->span = bands ? disp->format->span_band : disp->format->span;
+	pipe->band = bands ? bands + (color * disp->line_length) : NULL;
+	pipe->pixel = pixel_pack(disp->format, background_colors[color].r,
+				 background_colors[color].g, background_colors[color].b);
+	pipe->fade = fade;
+}
+
+/**
+ * disp_frame_init() - locate the visible area within the framebuffer
+ *
+ * @disp:	pointer to a valid and initialized display_info struct
+ *
+ * Only the visible area, yres lines of xres pixels at the xoffset and yoffset
+ * of the virtual space, is ever rendered and presented. Line padding and the
+ * rest of the virtual space are left alone.
+ *
+ * Return:	0 on success, -EINVAL if the visible area is not within the
+ *		framebuffer.
+ */
+static int disp_frame_init(struct display_info *disp)
+{
+	if (!disp->xres || !disp->yres || (disp->line_length < (disp->xres * disp->bpp)))
+		return -EINVAL;
+
+	disp->frame_len = ((size_t)(disp->yres - 1) * disp->line_length) +
+			  ((size_t)disp->xres * disp->bpp);
+	disp->offset = ((size_t)disp->var_info.yoffset * disp->line_length) +
+		       ((size_t)disp->var_info.xoffset * disp->bpp);
+	if ((disp->offset + disp->frame_len) > disp->fb_len)
+		return -EINVAL;
+
+	return 0;
+}
+
+/**
+ * disp_page() - get a page of the framebuffer
+ *
+ * @disp:	pointer to a valid, initialized and mmaped display_info struct
+ * @page:	index of the page
+ *
+ * Return:	pointer to the first pixel of @page.
+ */
+static inline uint8_t *disp_page(const struct display_info *disp, const uint32_t page)
+{
+	return disp->fb + ((size_t)page * disp->yres * disp->line_length);
+}
+
+/**
+ * disp_flip() - show a page of the framebuffer
+ *
+ * @disp:	pointer to a valid, initialized and mmaped display_info struct
+ * @page:	index of the page to show
+ *
+ * Pans the display to @page and, when supported by the driver, waits for the
+ * next vertical blank so that the previous page is no longer scanned out.
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int disp_flip(struct display_info *disp, const uint32_t page)
+{
+	uint32_t crtc = 0;
+
+	disp->var_info.yoffset = page * disp->yres;
+	if (ioctl(disp->fb_dev, FBIOPAN_DISPLAY, &disp->var_info) < 0)
+		return -errno;
+	disp->page = page;
+
+	if (disp->vsync && (ioctl(disp->fb_dev, FBIO_WAITFORVSYNC, &crtc) < 0)) {
+		fprintf(stderr, "Unable to wait for vsync, disabling: %s\n", strerror(errno));
+		disp->vsync = false;
+	}
+
+	return 0;
+}
+
+/**
+ * disp_flip_init() - select how frames are presented on the display
+ *
+ * @disp:	pointer to a valid, initialized and mmaped display_info struct
+ *
+ * When the driver offers at least twice the visible resolution as virtual
+ * space and supports panning along the Y-axis, frames are rendered directly
+ * into the off-screen page and flipped to. Otherwise frames are rendered in
+ * place, straight into the visible area of the framebuffer.
+ */
+static void disp_flip_init(struct display_info *disp)
+{
+	uint32_t crtc = 0;
+
+	disp->pages = 1;
+	disp->page = 0;
+	disp->vsync = false;
+
+	if ((disp->var_info.yres_virtual < (2 * disp->yres)) ||
+	    (disp->fb_len < (2 * (size_t)disp->yres * disp->line_length)) ||
+	    (disp->ypanstep == 0) || (disp->yres % disp->ypanstep)) {
+		printf("Presenting frames in place, no virtual space to page flip.\n");
+		return;
+	}
+
+	disp->var_info.xoffset = 0;
+	if (disp_flip(disp, 0)) {
+		printf("Presenting frames in place, unable to pan display: %s.\n", strerror(errno));
+		return;
+	}
+
+	disp->pages = 2;
+	disp->vsync = (ioctl(disp->fb_dev, FBIO_WAITFORVSYNC, &crtc) == 0);
+	printf("Presenting frames by page flipping, %s vsync.\n", disp->vsync ? "with" : "without");
+}
+
+/**
+ * struct region - rectangular area of the framebuffer
+ *
+ * @x:	first column of the area, in pixels
+ * @y:	first row of the area, in pixels
+ * @w:	width of the area, in pixels
+ * @h:	height of the area, in pixels
+ */
+struct region {
+	uint32_t x;
+	uint32_t y;
+	uint32_t w;
+	uint32_t h;
+};
+
+/**
+ * struct damage_info - dirty tile tracking of the render buffers
+ *
+ * @tile_w:		width of a tile, in pixels
+ * @tile_h:		height of a tile, in pixels
+ * @cols:		number of tiles along the X-axis
+ * @rows:		number of tiles along the Y-axis
+ * @level:		per tile intensity of the input mask, the touch state
+ * @queued:		per tile indicator whether it is in @list
+ * @list:		region list of tiles that need recomposing
+ * @count:		number of tiles in @list
+ * @present:		region list of tiles recomposed, waiting to be presented
+ * @present_count:	number of tiles in @present
+ * @stale:		region list of tiles recomposed into the other page
+ * @stale_count:	number of tiles in @stale
+ * @full:		the entire frame needs recomposing
+ * @full_pages:		number of pages that still need a full recompose
+ * @present_full:	the entire frame needs presenting
+ * @pending:		a recomposed frame is waiting to be presented
+ *
+ * The screen is split up in tiles the size of the test pattern, so that an
+ * input event always damages exactly one tile. Tiles stay on the dirty list
+ * for as long as their input mask is fading, after which the background
+ * remains unchanged and the tile no longer needs to be touched.
+ *
+ * When page flipping, every page is composed into every other frame. Tiles
+ * composed into the other page in the previous frame are therefore kept as
+ * stale, to be composed into the current page as well.
+ */
+struct damage_info {
+	uint32_t tile_w;
+	uint32_t tile_h;
+	uint32_t cols;
+	uint32_t rows;
+	uint8_t *level;
+	bool *queued;
+	uint32_t *list;
+	size_t count;
+	uint32_t *present;
+	size_t present_count;
+	uint32_t *stale;
+	size_t stale_count;
+	bool full;
+	uint32_t full_pages;
+	bool present_full;
+	bool pending;
+};
+
+/**
+ * damage_size() - get the space dirty tile tracking takes up in an arena
+ *
+ * @disp:	pointer to a valid and initialized display_info struct
+ * @xsize:	size along the X-axis for the test pattern
+ * @ysize:	size along the Y-axis for the test pattern
+ *
+ * Return:	size in bytes to reserve for damage_init().
+ */
+static size_t damage_size(const struct display_info *disp, const uint32_t xsize,
+			  const uint32_t ysize)
+{
+	size_t tiles = (size_t)((disp->xres + xsize - 1) / xsize) * ((disp->yres + ysize - 1) / ysize);
+	struct damage_info *damage;
+
+	return ARENA_SIZE(tiles * sizeof(*damage->level)) +
+	       ARENA_SIZE(tiles * sizeof(*damage->queued)) +
+	       (3 * ARENA_SIZE(tiles * sizeof(*damage->list)));
+}
+
+/**
+ * damage_init() - initialize dirty tile tracking
+ *
+ * @damage:	damage_info structure to initialize
+ * @arena:	arena to allocate the tile buffers from
+ * @disp:	pointer to a valid and initialized display_info struct
+ * @xsize:	size along the X-axis for the test pattern
+ * @ysize:	size along the Y-axis for the test pattern
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int damage_init(struct damage_info *damage, struct arena *arena,
+		       const struct display_info *disp, const uint32_t xsize,
+		       const uint32_t ysize)
+{
+	size_t tiles;
+
+	memset(damage, 0, sizeof(*damage));
+	damage->tile_w = xsize;
+	damage->tile_h = ysize;
+	damage->cols = (disp->xres + xsize - 1) / xsize;
+	damage->rows = (disp->yres + ysize - 1) / ysize;
+	damage->full = true;
+
+	tiles = damage->cols * damage->rows;
+	damage->level = arena_alloc(arena, tiles * sizeof(*damage->level));
+	damage->queued = arena_alloc(arena, tiles * sizeof(*damage->queued));
+	damage->list = arena_alloc(arena, tiles * sizeof(*damage->list));
+	damage->present = arena_alloc(arena, tiles * sizeof(*damage->present));
+	damage->stale = arena_alloc(arena, tiles * sizeof(*damage->stale));
+	if (!damage->level || !damage->queued || !damage->list ||
+	    !damage->present || !damage->stale)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/**
+ * damage_mark() - mark a tile as freshly touched
+ *
+ * @damage:	pointer to a valid and initialized damage_info struct
+ * @col:	column of the tile to mark
+ * @row:	row of the tile to mark
+ */
+static void damage_mark(struct damage_info *damage, const uint32_t col, const uint32_t row)
+{
+	uint32_t tile = (row * damage->cols) + col;
+
+	damage->level[tile] = UINT8_MAX;
+	if (!damage->queued[tile]) {
+		damage->queued[tile] = true;
+		damage->list[damage->count++] = tile;
+	}
+}
+
+/**
+ * damage_region() - get the screen area covered by a tile
+ *
+ * @damage:	pointer to a valid and initialized damage_info struct
+ * @disp:	pointer to a valid and initialized display_info struct
+ * @tile:	index of the tile
+ * @region:	returns the area of the tile, clipped to the screen
+ */
+static void damage_region(const struct damage_info *damage, const struct display_info *disp,
+			  const uint32_t tile, struct region *region)
+{
+	region->x = (tile % damage->cols) * damage->tile_w;
+	region->y = (tile / damage->cols) * damage->tile_h;
+	region->w = damage->tile_w;
+	region->h = damage->tile_h;
+
+	if ((region->x + region->w) > disp->xres)
+		region->w = disp->xres - region->x;
+	if ((region->y + region->h) > disp->yres)
+		region->h = disp->yres - region->y;
+}
+
+/**
+ * frame_region() - get the area covering the entire frame
+ *
+ * @disp:	pointer to a valid and initialized display_info struct
+ * @region:	returns the visible area of the display
+ */
+static void frame_region(const struct display_info *disp, struct region *region)
+{
+	region->x = 0;
+	region->y = 0;
+	region->w = disp->xres;
+	region->h = disp->yres;
+}
+
+/**
+ * mask_span() - get the span of pixels sharing the same input mask intensity
+ *
+ * @damage:	pointer to a valid and initialized damage_info struct
+ * @levels:	intensities of the row of tiles, NULL for rows without input
+ * @x:		first pixel of the span
+ * @level:	returns the intensity of the input mask of the span
+ *
+ * The input mask of a tile covers all of the tile except for a border of
+ * TEST_PATTERN_BORDER at its right and bottom edge.
+ *
+ * Return:	the first pixel after the span.
+ */
+static inline uint32_t mask_span(const struct damage_info *damage, const uint8_t *levels,
+				 const uint32_t x, uint8_t *level)
+{
+	uint32_t col = x / damage->tile_w;
+	uint32_t border = ((col + 1) * damage->tile_w) - TEST_PATTERN_BORDER;
+
+	*level = 0;
+	if (!levels || (col >= damage->cols))
+		return UINT32_MAX;
+
+	if (x < border) {
+		*level = levels[col];
+		return border;
+	}
+
+	return (col + 1) * damage->tile_w;
+}
+
+/**
+ * background_draw() - render the background with input events
+ *
+ * @buffer:	buffer to render the background and input events onto
+ * @damage:	pointer to a valid and initialized damage_info struct
+ * @disp:	pointer to a valid and initialized display_info struct
+ * @pipe:	render variant from render_pipeline_select()
+ * @region:	area of the buffer to render
+ *
+ * This function combines a (predefined static) background color from
+ * @background_colors and the input mask held by the tiles of @damage. The
+ * combining operation is to invert the mask onto the background. As the mask
+ * is uniform across a tile, every row is rendered as a few spans of identical
+ * pixels, by the span renderer selected for the pixel format of the display.
+ *
+ * Note that the @buffer needs to be the same size as the framebuffer.
+ */
+static void background_draw(uint8_t *buffer, const struct damage_info *damage,
+			    const struct display_info *disp, const struct render_pipeline *pipe,
+			    const struct region *region)
+{
+	uint32_t end = region->x + region->w;
+	uint32_t row;
+
+	for (row = region->y; row < (region->y + region->h); row++) {
+		uint8_t *line = buffer + (row * disp->line_length);
+		const uint8_t *levels = NULL;
+		uint32_t x = region->x;
+
+		if (((row / damage->tile_h) < damage->rows) &&
+		    ((row % damage->tile_h) < (damage->tile_h - TEST_PATTERN_BORDER)))
+			levels = damage->level + ((row / damage->tile_h) * damage->cols);
+
+		while (x < end) {
+			uint32_t start = x;
+			uint8_t level;
+
+			x = mask_span(damage, levels, x, &level);
+			while (x < end) {
+				uint8_t next_level;
+				uint32_t next;
+
+				next = mask_span(damage, levels, x, &next_level);
+				if (next_level != level)
+					break;
+				x = next;
+			}
+			if (x > end)
+				x = end;
+
+			pipe->span(line, pipe->band, pipe->pixel, disp->masks[level], start, x);
+		}
+	}
+}
+
+/**
+ * struct coverage - touch coverage of the test pattern grid
+ *
+ * @cols:	number of whole cells along the X-axis
+ * @rows:	number of whole cells along the Y-axis
+ * @cells:	number of cells, @cols * @rows
+ * @covered:	number of cells touched during the current pass
+ * @passes:	number of passes that touched every cell
+ * @start:	monotonic time in ns the coverage was started at
+ * @last:	cell of the previous touch sample, @cells if none
+ * @last_time:	time in ns of the previous touch sample
+ * @touched:	per cell, whether it was touched during the current pass
+ * @hits:	per cell, number of touch samples over all passes
+ * @dwell:	per cell, time in ns the touch stayed within it
+ * @first:	per cell, time in ns of the first touch since @start, 0 if none
+ * @min_x:	per cell, smallest reported x coordinate
+ * @min_y:	per cell, smallest reported y coordinate
+ * @max_x:	per cell, largest reported x coordinate
+ * @max_y:	per cell, largest reported y coordinate
+ *
+ * Only whole cells are part of the grid, touches in the partial cells at the
+ * right and bottom edge are not counted. The per cell values are kept as
+ * separate arrays, so that marking a touch and checking completion touch as
+ * little memory as possible. A touch counts towards the dwell time of a cell
+ * if the previous touch sample was in the same cell, at most
+ * COVERAGE_DWELL_GAP_NS earlier.
+ */
+struct coverage {
+	uint32_t cols;
+	uint32_t rows;
+	size_t cells;
+	size_t covered;
+	uint32_t passes;
+	uint64_t start;
+	size_t last;
+	uint64_t last_time;
+	bool *touched;
+	uint32_t *hits;
+	uint64_t *dwell;
+	uint64_t *first;
+	int32_t *min_x;
+	int32_t *min_y;
+	int32_t *max_x;
+	int32_t *max_y;
+};
+
+/**
+ * coverage_size() - get the space the coverage takes up in an arena
+ *
+ * @disp:	pointer to a valid and initialized display_info struct
+ * @xsize:	size along the X-axis for the test pattern
+ * @ysize:	size along the Y-axis for the test pattern
+ *
+ * Return:	size in bytes to reserve for coverage_init().
+ */
+static size_t coverage_size(const struct display_info *disp, const uint32_t xsize,
+			    const uint32_t ysize)
+{
+	size_t cells = (size_t)(disp->xres / xsize) * (disp->yres / ysize);
+	struct coverage *coverage;
+
+	return ARENA_SIZE(cells * sizeof(*coverage->touched)) +
+	       ARENA_SIZE(cells * sizeof(*coverage->hits)) +
+	       (2 * ARENA_SIZE(cells * sizeof(*coverage->dwell))) +
+	       (4 * ARENA_SIZE(cells * sizeof(*coverage->min_x)));
+}
+
+/**
+ * coverage_init() - set up the coverage of the test pattern grid
+ *
+ * @coverage:	coverage structure to initialize
+ * @arena:	arena to allocate the cell statistics from
+ * @disp:	pointer to a valid and initialized display_info struct
+ * @xsize:	size along the X-axis for the test pattern
+ * @ysize:	size along the Y-axis for the test pattern
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int coverage_init(struct coverage *coverage, struct arena *arena,
+			 const struct display_info *disp, const uint32_t xsize,
+			 const uint32_t ysize)
+{
+	memset(coverage, 0, sizeof(*coverage));
+	coverage->cols = disp->xres / xsize;
+	coverage->rows = disp->yres / ysize;
+	coverage->cells = (size_t)coverage->cols * coverage->rows;
+	coverage->last = coverage->cells;
+	coverage->start = now_ns();
+
+	coverage->touched = arena_alloc(arena, coverage->cells * sizeof(*coverage->touched));
+	coverage->hits = arena_alloc(arena, coverage->cells * sizeof(*coverage->hits));
+	coverage->dwell = arena_alloc(arena, coverage->cells * sizeof(*coverage->dwell));
+	coverage->first = arena_alloc(arena, coverage->cells * sizeof(*coverage->first));
+	coverage->min_x = arena_alloc(arena, coverage->cells * sizeof(*coverage->min_x));
+	coverage->min_y = arena_alloc(arena, coverage->cells * sizeof(*coverage->min_y));
+	coverage->max_x = arena_alloc(arena, coverage->cells * sizeof(*coverage->max_x));
+	coverage->max_y = arena_alloc(arena, coverage->cells * sizeof(*coverage->max_y));
+	if (!coverage->touched || !coverage->hits || !coverage->dwell || !coverage->first ||
+	    !coverage->min_x || !coverage->min_y || !coverage->max_x || !coverage->max_y)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/**
+ * coverage_hit() - record a touch sample in a cell
+ *
+ * @coverage:	pointer to a valid and initialized coverage struct
+ * @cell:	index of the touched cell
+ * @x:		reported x coordinate of the touch
+ * @y:		reported y coordinate of the touch
+ * @time:	time of the touch on CLOCK_MONOTONIC, in nanoseconds
+ */
+static void coverage_hit(struct coverage *coverage, const size_t cell,
+			 const int32_t x, const int32_t y, const uint64_t time)
+{
+	if (!coverage->touched[cell]) {
+		coverage->touched[cell] = true;
+		coverage->covered++;
+	}
+
+	if (!coverage->hits[cell]) {
+		coverage->first[cell] = (time > coverage->start) ? time - coverage->start : 1;
+		coverage->min_x[cell] = x;
+		coverage->min_y[cell] = y;
+		coverage->max_x[cell] = x;
+		coverage->max_y[cell] = y;
+	}
+	coverage->hits[cell]++;
+	if (x < coverage->min_x[cell])
+		coverage->min_x[cell] = x;
+	if (y < coverage->min_y[cell])
+		coverage->min_y[cell] = y;
+	if (x > coverage->max_x[cell])
+		coverage->max_x[cell] = x;
+	if (y > coverage->max_y[cell])
+		coverage->max_y[cell] = y;
+
+	if ((cell == coverage->last) && (time > coverage->last_time) &&
+	    ((time - coverage->last_time) <= COVERAGE_DWELL_GAP_NS))
+		coverage->dwell[cell] += time - coverage->last_time;
+	coverage->last = cell;
+	coverage->last_time = time;
+}
+
+/**
+ * coverage_check() - check whether all cells were touched
+ *
+ * @coverage:	pointer to a valid and initialized coverage struct
+ *
+ * Checks if all cells have been touched during the current pass. When so,
+ * print this to stdout and start the next pass. The statistics per cell are
+ * kept over all passes.
+ *
+ * Return:	true if all cells were touched, false otherwise.
+ */
+static bool coverage_check(struct coverage *coverage)
+{
+	if (!coverage->cells || (coverage->covered < coverage->cells))
+		return false;
+
+	puts("Input test: success");
+	coverage->passes++;
+	coverage->covered = 0;
+	memset(coverage->touched, false, coverage->cells * sizeof(*coverage->touched));
+
+	return true;
+}
+
+/**
+ * coverage_report() - print the coverage and a heat map of the touches
+ *
+ * @coverage:	pointer to a valid and initialized coverage struct
+ *
+ * Cells that were never touched are dead zones and printed as '.', the others
+ * as 1 to 9 relative to the most touched cell.
+ */
+static void coverage_report(const struct coverage *coverage)
+{
+	uint32_t max = 0;
+	size_t dead = 0;
+	size_t cell;
+	uint32_t row;
+
+	for (cell = 0; cell < coverage->cells; cell++) {
+		if (coverage->hits[cell] > max)
+			max = coverage->hits[cell];
+		if (!coverage->hits[cell])
+			dead++;
+	}
+
+	printf("Coverage: %u passes complete, %zu of %zu cells touched in current pass, %zu cells never touched\n",
+	       coverage->passes, coverage->covered, coverage->cells, dead);
+	if (!max)
+		return;
+
+	for (row = 0; row < coverage->rows; row++) {
+		char line[coverage->cols + 1];
+		uint32_t col;
+
+		for (col = 0; col < coverage->cols; col++) {
+			uint32_t hits = coverage->hits[(row * coverage->cols) + col];
+
+			line[col] = hits ? '1' + (uint32_t)(((uint64_t)hits * 8) / max) : '.';
+		}
+		line[col] = '\0';
+		printf("  %s\n", line);
+	}
+}
+
+/**
+ * coverage_save() - write the statistics of every cell to a CSV file
+ *
+ * @coverage:	pointer to a valid and initialized coverage struct
+ * @path:	file to write to
+ * @xsize:	size along the X-axis for the test pattern
+ * @ysize:	size along the Y-axis for the test pattern
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int coverage_save(const struct coverage *coverage, const char *path,
+			 const uint32_t xsize, const uint32_t ysize)
+{
+	FILE *file;
+	size_t cell;
+	int ret = 0;
+
+	file = fopen(path, "w");
+	if (!file) {
+		int err = errno;
+
+		fprintf(stderr, "Unable to open '%s': %s\n", path, strerror(err));
+		return -err;
+	}
+
+	fprintf(file, "col,row,x,y,width,height,hits,dwell_ms,first_ms,min_x,min_y,max_x,max_y\n");
+	for (cell = 0; cell < coverage->cells; cell++) {
+		uint32_t col = cell % coverage->cols;
+		uint32_t row = cell / coverage->cols;
+
+		fprintf(file, "%u,%u,%u,%u,%u,%u,%u,%.3f,",
+			col, row, col * xsize, row * ysize, xsize, ysize, coverage->hits[cell],
+			(double)coverage->dwell[cell] / NSEC_PER_MSEC);
+		if (coverage->hits[cell])
+			fprintf(file, "%.3f,%d,%d,%d,%d\n",
+				(double)coverage->first[cell] / NSEC_PER_MSEC,
+				coverage->min_x[cell], coverage->min_y[cell],
+				coverage->max_x[cell], coverage->max_y[cell]);
+		else
+			fprintf(file, ",,,,\n");
+	}
+
+	if (ferror(file))
+		ret = -EIO;
+	if (fclose(file) && !ret)
+		ret = -errno;
+	if (ret)
+		fprintf(stderr, "Failed to write coverage to '%s': %s\n", path, strerror(-ret));
+	else
+		printf("Coverage written to '%s'.\n", path);
+
+	return ret;
+}
+
+/**
+ * input_mark() - mark received input events
+ *
+ * @coverage:	coverage of the test pattern grid to record the touch in
+ * @damage:	dirty tile tracking to record the touched tile in
+ * @disp:	pointer to a valid and initialized display_info struct
+ * @x:		x coordinate of input event to render
+ * @y:		y coordinate of input event to render
+ * @time:	time of the input event on CLOCK_MONOTONIC, in nanoseconds
+ * @xsize:	size along the X-axis for the test pattern
+ * @ysize:	size along the Y-axis for the test pattern
+ *
+ * This function will mark the tile of size <xsize>x<ysize> the input event
+ * falls in at full intensity, which is rendered as test pattern separated by
+ * a border of TEST_PATTERN_BORDER size. For automatic test verification the
+ * input event is also recorded in @coverage.
+ *
+ * Input events outside of the visible screen area are ignored.
+ *
+ * Return:	true if the input event was marked, false if it was ignored.
+ */
+static bool input_mark(struct coverage *coverage, struct damage_info *damage,
+		       const struct display_info *disp, int32_t x, int32_t y,
+		       const uint64_t time, uint32_t xsize, uint32_t ysize)
+{
+	uint32_t col, row;
+
+	if ((x < 0) || (y < 0) || ((uint32_t)x >= disp->xres) || ((uint32_t)y >= disp->yres))
+		return false;
+
+	col = x / xsize;
+	row = y / ysize;
+	if ((col < coverage->cols) && (row < coverage->rows))
+		coverage_hit(coverage, ((size_t)row * coverage->cols) + col, x, y, time);
+	damage_mark(damage, col, row);
+
+	return true;
+}
+
+/**
+ * input_fade() - helper function to fade the input events away
+ *
+ * @damage:	dirty tile tracking holding the input mask intensities
+ * @speed:	speed of fade (decay) of the test pattern
+ *
+ * Function to remove any input events using @speed as a sort of decay
+ * speed. Only a single intensity per tile is kept, so this is a pass over
+ * the tile grid, not over the frame.
+ */
+static void input_fade(struct damage_info *damage, const uint8_t speed)
+{
+	kernel->fade(damage->level, damage->cols * damage->rows, speed);
+}
+
+/**
+ * region_clip() - clip an area to a range of rows
+ *
+ * @region:	area to clip
+ * @y0:		first row of the range
+ * @y1:		first row after the range
+ *
+ * Return:	true if anything of @region remains, false otherwise.
+ */
+static bool region_clip(struct region *region, const uint32_t y0, const uint32_t y1)
+{
+	uint32_t end = region->y + region->h;
+
+	if (region->y < y0)
+		region->y = y0;
+	if (end > y1)
+		end = y1;
+	if (end <= region->y)
+		return false;
+	region->h = end - region->y;
+
+	return true;
+}
+
+/**
+ * damage_draw() - recompose the damaged parts of a stripe of the frame
+ *
+ * @damage:	pointer to a valid and initialized damage_info struct
+ * @buffer:	buffer to render the background and input events onto
+ * @disp:	pointer to a valid and initialized display_info struct
+ * @pipe:	render variant from render_pipeline_select()
+ * @full:	recompose the entire frame instead of the queued tiles
+ * @y0:		first row of the stripe
+ * @y1:		first row after the stripe
+ *
+ * Every tile queued for presentation is recomposed, as far as it overlaps
+ * the stripe. The stripes of a frame never share a line of @buffer, so they
+ * can be rendered concurrently.
+ */
+static void damage_draw(const struct damage_info *damage, uint8_t *buffer,
+			const struct display_info *disp, const struct render_pipeline *pipe,
+			const bool full, const uint32_t y0, const uint32_t y1)
+{
+	struct region region;
+	size_t i;
+
+	if (full) {
+		frame_region(disp, &region);
+		if (region_clip(&region, y0, y1))
+			background_draw(buffer, damage, disp, pipe, &region);
+
+		return;
+	}
+
+	for (i = 0; i < damage->present_count; i++) {
+		damage_region(damage, disp, damage->present[i], &region);
+		if (region_clip(&region, y0, y1))
+			background_draw(buffer, damage, disp, pipe, &region);
+	}
+}
+
+/**
+ * struct render_job - frame to be recomposed by the render pool
+ *
+ * @damage:	dirty tile tracking of the frame
+ * @buffer:	buffer to render the frame into
+ * @disp:	display the frame is rendered for
+ * @pipe:	render variant from render_pipeline_select()
+ * @full:	recompose the entire frame instead of the queued tiles
+ */
+struct render_job {
+	const struct damage_info *damage;
+	uint8_t *buffer;
+	const struct display_info *disp;
+	const struct render_pipeline *pipe;
+	bool full;
+};
+
+/**
+ * struct render_worker - render thread of the render pool
+ *
+ * @pool:	render pool the worker belongs to
+ * @thread:	handle of the worker thread
+ * @stripe:	index of the stripe of the frame rendered by the worker
+ * @frame:	sequence number of the last frame rendered by the worker
+ */
+struct render_worker {
+	struct render_pool *pool;
+	pthread_t thread;
+	uint32_t stripe;
+	uint64_t frame;
+};
+
+/**
+ * struct render_pool - pool of threads rendering frames in stripes
+ *
+ * @workers:	worker threads, rendering all but the first stripe
+ * @nworkers:	number of running threads in @workers
+ * @stripes:	number of stripes a frame is split into
+ * @lock:	protects all members below
+ * @start:	signalled when a new frame is to be rendered
+ * @done:	signalled when the last worker finished its stripe
+ * @job:	frame to be rendered
+ * @frame:	sequence number of @job
+ * @busy:	number of workers still rendering @job
+ * @quit:	workers should exit
+ *
+ * The frame is split into horizontal stripes of whole lines, one per thread.
+ * The calling thread renders the first stripe itself and then waits for the
+ * workers to finish theirs, so that the frame is complete before it is
+ * presented.
+ */
+struct render_pool {
+	struct render_worker *workers;
+	uint32_t nworkers;
+	uint32_t stripes;
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	struct render_job job;
+	uint64_t frame;
+	uint32_t busy;
+	bool quit;
+};
+
+/**
+ * render_stripe() - render a single stripe of a frame
+ *
+ * @job:	frame to render
+ * @stripe:	index of the stripe to render
+ * @stripes:	number of stripes the frame is split into
+ */
+static void render_stripe(const struct render_job *job, const uint32_t stripe,
+			  const uint32_t stripes)
+{
+	struct region region;
+	uint32_t y0, y1;
+
+	frame_region(job->disp, &region);
+	y0 = ((uint64_t)region.h * stripe) / stripes;
+	y1 = ((uint64_t)region.h * (stripe + 1)) / stripes;
+
+	damage_draw(job->damage, job->buffer, job->disp, job->pipe, job->full, y0, y1);
+}
+
+/**
+ * render_worker() - render thread main loop
+ *
+ * @arg:	pointer to the render_worker struct of the thread
+ *
+ * Return:	always NULL.
+ */
+static void *render_worker(void *arg)
+{
+	struct render_worker *worker = arg;
+	struct render_pool *pool = worker->pool;
+	struct render_job job;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		while (!pool->quit && (pool->frame == worker->frame))
+			pthread_cond_wait(&pool->start, &pool->lock);
+		if (pool->quit) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		worker->frame = pool->frame;
+		job = pool->job;
+		pthread_mutex_unlock(&pool->lock);
+
+		render_stripe(&job, worker->stripe, pool->stripes);
+
+		pthread_mutex_lock(&pool->lock);
+		if (!--pool->busy)
+			pthread_cond_signal(&pool->done);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return NULL;
+}
+
+/**
+ * render_pool_init() - start the render threads
+ *
+ * @pool:	render_pool structure to initialize
+ * @threads:	total number of threads to render with, including the caller
+ *
+ * If not all threads can be started, the frame is split up over the threads
+ * that could. Note that the caller is responsible for calling
+ * render_pool_free() when done.
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int render_pool_init(struct render_pool *pool, const uint32_t threads)
+{
+	uint32_t i;
+	int ret;
+
+	memset(pool, 0, sizeof(*pool));
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	pool->stripes = 1;
+	if (threads < 2)
+		return 0;
+
+	pool->workers = calloc(threads - 1, sizeof(*pool->workers));
+	if (!pool->workers)
+		return -ENOMEM;
+
+	for (i = 0; i < (threads - 1); i++) {
+		struct render_worker *worker = &pool->workers[i];
+
+		worker->pool = pool;
+		worker->stripe = i + 1;
+		ret = pthread_create(&worker->thread, NULL, render_worker, worker);
+		if (ret) {
+			fprintf(stderr, "Unable to start render thread: %s\n", strerror(ret));
+			break;
+		}
+		pool->nworkers++;
+	}
+	pool->stripes = pool->nworkers + 1;
+
+	return 0;
+}
+
+/**
+ * render_pool_free() - stop the render threads
+ *
+ * @pool:	render_pool structure to clean up
+ */
+static void render_pool_free(struct render_pool *pool)
+{
+	uint32_t i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->nworkers; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+	free(pool->workers);
+
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->start);
+	pthread_mutex_destroy(&pool->lock);
+}
+
+/**
+ * render_pool_draw() - render a frame using all threads of the pool
+ *
+ * @pool:	pointer to a valid and initialized render_pool struct
+ * @job:	frame to render
+ *
+ * Returns once all stripes of the frame have been rendered.
+ */
+static void render_pool_draw(struct render_pool *pool, const struct render_job *job)
+{
+	if (!pool->nworkers) {
+		render_stripe(job, 0, 1);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->job = *job;
+	pool->busy = pool->nworkers;
+	pool->frame++;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	render_stripe(job, 0, pool->stripes);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->busy)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * damage_compose() - fade and recompose all damaged parts of the frame
+ *
+ * @damage:	pointer to a valid and initialized damage_info struct
+ * @pool:	pointer to a valid and initialized render_pool struct
+ * @buffer:	buffer to render the background and input events onto
+ * @disp:	pointer to a valid and initialized display_info struct
+ * @pipe:	render variant from render_pipeline_select()
+ *
+ * The input mask of all tiles is faded, unless fading is disabled. Every tile
+ * on the dirty list is then queued for presentation and recomposed by @pool.
+ * Tiles whose mask has not fully faded yet are kept on the dirty list for the
+ * next frame. When the entire frame is flagged as damaged, for example due to a
+ * background color change, the whole buffer is recomposed instead, once for
+ * every page.
+ *
+ * As the mask holds a single intensity per tile, fading, composing it onto
+ * the background and writing the result out is a single pass, which only
+ * ever stores to @buffer. @buffer may thus be the framebuffer itself.
+ */
+static void damage_compose(struct damage_info *damage, struct render_pool *pool,
+			   uint8_t *buffer, const struct display_info *disp,
+			   const struct render_pipeline *pipe)
+{
+	struct render_job job = {
+		.damage = damage,
+		.buffer = buffer,
+		.disp = disp,
+		.pipe = pipe,
+	};
+	uint32_t *stale = damage->present;
+	size_t i, keep = 0;
+
+	if (damage->full) {
+		damage->full_pages = disp->pages;
+		damage->full = false;
+	}
+
+	/* Only tiles on the dirty list can hold a mask that is not fully faded. */
+	if (pipe->fade && damage->count)
+		input_fade(damage, pipe->fade);
+
+	damage->present = damage->stale;
+	damage->stale = stale;
+	damage->stale_count = damage->present_count;
+	damage->present_count = 0;
+
+	for (i = 0; i < damage->stale_count; i++) {
+		uint32_t tile = damage->stale[i];
+
+		if (!damage->queued[tile])
+			damage->present[damage->present_count++] = tile;
+	}
+
+	for (i = 0; i < damage->count; i++) {
+		uint32_t tile = damage->list[i];
+
+		damage->present[damage->present_count++] = tile;
+
+		if (pipe->fade && damage->level[tile])
+			damage->list[keep++] = tile;
+		else
+			damage->queued[tile] = false;
+	}
+	damage->count = keep;
+
+	if (damage->full_pages) {
+		job.full = true;
+		damage->full_pages--;
+		damage->present_full = true;
+	}
+
+	if (job.full || damage->present_count)
+		render_pool_draw(pool, &job);
+
+	damage->pending = damage->present_full || damage->present_count;
+}
+
+/**
+ * damage_present() - present the recomposed frame on the display
+ *
+ * @damage:	pointer to a valid and initialized damage_info struct
+ * @disp:	pointer to a valid, initialized and mmaped display_info struct
+ *
+ * When page flipping, the page holding the composed frame is flipped to.
+ * Otherwise the frame was composed in place and is already on the display.
+ * Should the display fail to pan, frames are presented in place from then on,
+ * starting with a full recompose of the page that is still shown.
+ */
+static void damage_present(struct damage_info *damage, struct display_info *disp)
+{
+	int ret;
+
+	if (!damage->pending)
+		return;
+	damage->pending = false;
+	damage->present_full = false;
+
+	if (disp->pages == 1) {
+		damage->present_count = 0;
+		return;
+	}
+
+	ret = disp_flip(disp, (disp->page + 1) % disp->pages);
+	if (!ret)
+		return;
+
+	fprintf(stderr, "Unable to pan display, presenting frames in place: %s\n", strerror(-ret));
+	disp->pages = 1;
+	disp->offset = disp_page(disp, disp->page) - disp->fb;
+	damage->present_count = 0;
+	damage->full = true;
+}
+
+/**
+ * damage_idle() - check whether composing a frame would leave it unchanged
+ *
+ * @damage:	pointer to a valid and initialized damage_info struct
+ *
+ * Return:	true if the frame is not flagged as damaged, no tile is dirty and
+ *		no tile still has to be recomposed on another page, false
+ *		otherwise.
+ */
+static bool damage_idle(const struct damage_info *damage)
+{
+	return !damage->full && !damage->full_pages && !damage->count &&
+	       !damage->present_count && !damage->pending;
+}
+
+/**
+ * disp_target() - get the buffer to compose the next frame into
+ *
+ * @disp:	pointer to a valid, initialized and mmaped display_info struct
+ *
+ * Return:	the off-screen page when page flipping, the visible area of the
+ *		framebuffer otherwise.
+ */
+static inline uint8_t *disp_target(const struct display_info *disp)
+{
+	if (disp->pages > 1)
+		return disp_page(disp, (disp->page + 1) % disp->pages);
+
+	return disp->fb + disp->offset;
+}
+
+/**
+ * struct input_sample - touch position as reported by the input device
+ *
+ * @x:		x coordinate of the touch
+ * @y:		y coordinate of the touch
+ * @time:	time of the report on CLOCK_MONOTONIC, in nanoseconds
+ * @read:	time the report was read by the input thread, in nanoseconds
+ */
+struct input_sample {
+	int32_t x;
+	int32_t y;
+	uint64_t time;
+	uint64_t read;
+};
+
+/**
+ * struct input_ring - lock-free single producer, single consumer sample queue
+ *
+ * @head:	number of samples ever written, only written by the producer
+ * @tail:	number of samples ever read, only written by the consumer
+ * @samples:	storage of the queued samples
+ *
+ * Both indices run freely and are masked by INPUT_RING_SIZE, which must be a
+ * power of two, on access. They are kept on their own cache line, so that the
+ * producer and consumer do not bounce a line between them on every sample.
+ */
+struct input_ring {
+	uint32_t head __attribute__((aligned(64)));
+	uint32_t tail __attribute__((aligned(64)));
+	struct input_sample samples[INPUT_RING_SIZE] __attribute__((aligned(64)));
+};
+
+/**
+ * input_ring_full() - check whether no more samples can be queued
+ *
+ * @ring:	pointer to a valid input_ring struct
+ *
+ * Must only be called from the producer thread.
+ *
+ * Return:	true if the ring is full, false otherwise.
+ */
+static bool input_ring_full(const struct input_ring *ring)
+{
+	return (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) >= INPUT_RING_SIZE;
+}
+
+/**
+ * input_ring_push() - queue a sample
+ *
+ * @ring:	pointer to a valid input_ring struct
+ * @sample:	sample to queue
+ *
+ * Must only be called from the producer thread.
+ *
+ * Return:	true on success, false if the ring is full.
+ */
+static bool input_ring_push(struct input_ring *ring, const struct input_sample *sample)
+{
+	uint32_t head = ring->head;
+
+	if (input_ring_full(ring))
+		return false;
+
+	ring->samples[head & (INPUT_RING_SIZE - 1)] = *sample;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+/**
+ * input_ring_pending() - check whether samples are queued
+ *
+ * @ring:	pointer to a valid input_ring struct
+ *
+ * Must only be called from the consumer thread.
+ *
+ * Return:	true if at least one sample is queued, false otherwise.
+ */
+static bool input_ring_pending(const struct input_ring *ring)
+{
+	return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != ring->tail;
+}
+
+/**
+ * input_ring_pop() - dequeue a batch of samples
+ *
+ * @ring:	pointer to a valid input_ring struct
+ * @samples:	returns the dequeued samples, oldest first
+ * @count:	maximum number of samples to dequeue
+ *
+ * Must only be called from the consumer thread.
+ *
+ * Return:	the number of samples dequeued.
+ */
+static size_t input_ring_pop(struct input_ring *ring, struct input_sample *samples,
+			     const size_t count)
+{
+	uint32_t tail = ring->tail;
+	size_t avail = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+	size_t i;
+
+	if (avail > count)
+		avail = count;
+
+	for (i = 0; i < avail; i++)
+		samples[i] = ring->samples[(tail + i) & (INPUT_RING_SIZE - 1)];
+	__atomic_store_n(&ring->tail, tail + avail, __ATOMIC_RELEASE);
+
+	return avail;
+}
+
+struct input_dev;
+
+/**
+ * struct input_filter - which input devices to attach to
+ *
+ * @sysfs:	root of the sysfs tree to probe the input devices with
+ * @match:	phys or uniq identifier of the device, NULL for any capable device
+ * @grab:	grab the device for exclusive access, so that no other station
+ *		attaches to it as well
+ * @id:		bus, vendor and product of the device first attached to
+ * @identified:	only attach to devices with the same @id, set once a device
+ *		was attached to, so that a lost device is only replaced by itself
+ */
+struct input_filter {
+	const char *sysfs;
+	const char *match;
+	bool grab;
+	struct input_id id;
+	bool identified;
+};
+
+/**
+ * struct input_ops - operations of an input backend
+ *
+ * @get_fd:	get a file descriptor that is readable when events are pending
+ * @next_event:	get the next event, with the semantics of libevdev_next_event()
+ * @fetch_abs:	get the current value of an absolute axis
+ * @abs_info:	get the properties of an absolute axis, NULL if unknown
+ * @touching:	whether the device state holds an active contact
+ * @lossless:	whether events are held back while the render loop falls
+ *		behind, instead of being dropped, NULL if they are dropped
+ * @reconnect:	attach to the device again after it was lost, NULL if the
+ *		backend can not be lost
+ * @free:	release the backend
+ */
+struct input_ops {
+	int (*get_fd)(const struct input_dev *input);
+	int (*next_event)(struct input_dev *input, const unsigned int flags,
+			  struct input_event *event);
+	int (*fetch_abs)(const struct input_dev *input, const unsigned int code, int *value);
+	const struct input_absinfo *(*abs_info)(const struct input_dev *input,
+						const unsigned int code);
+	bool (*touching)(const struct input_dev *input);
+	bool (*lossless)(const struct input_dev *input);
+	int (*reconnect)(struct input_dev *input, const struct input_filter *filter,
+			 const char *name);
+	void (*free)(struct input_dev *input);
+};
+
+/**
+ * struct input_dev - source of input events
+ *
+ * @ops:	operations of the backend
+ * @priv:	private data of the backend
+ *
+ * Input events are either read from an input event device using libevdev, or
+ * generated from a script for runs without touch hardware.
+ */
+struct input_dev {
+	const struct input_ops *ops;
+	void *priv;
+};
+
+/**
+ * struct input_reader - input thread feeding touch samples to the render loop
+ *
+ * @input:	input device read by the thread, owned by the thread while running
+ * @thread:	handle of the reader thread
+ * @notifyfd:	eventfd signalled when samples are queued or the device is lost
+ * @quitfd:	eventfd signalled to stop the reader thread
+ * @spacefd:	eventfd signalled when samples are dequeued while @waiting
+ * @waiting:	the reader thread waits for room in @ring
+ * @ring:	queue of touch samples
+ * @samples:	number of samples queued
+ * @overflows:	number of samples dropped because @ring was full
+ * @resyncs:	number of resyncs after the kernel event buffer overran
+ * @losses:	number of times the input device was lost
+ * @reconnects:	number of times the input device was attached to again
+ * @reconnect_ns:	total time, in nanoseconds, until the device was attached
+ * @reconnect_max:	longest time, in nanoseconds, until the device was attached
+ * @filter:	input devices to attach to again after the device was lost
+ * @error:	error the input device returned, after which the thread exited
+ *
+ * The counters are written by the reader thread only and may be read from
+ * any thread.
+ */
+struct input_reader {
+	struct input_dev *input;
+	pthread_t thread;
+	int notifyfd;
+	int quitfd;
+	int spacefd;
+	bool waiting;
+	struct input_ring ring;
+	uint64_t samples;
+	uint64_t overflows;
+	uint64_t resyncs;
+	uint64_t losses;
+	uint64_t reconnects;
+	uint64_t reconnect_ns;
+	uint64_t reconnect_max;
+	const struct input_filter *filter;
+	int error;
+};
+
+/**
+ * input_reader_queue() - queue a touch sample to the render loop
+ *
+ * @reader:	pointer to a valid and started input_reader struct
+ * @x:		x coordinate of the touch
+ * @y:		y coordinate of the touch
+ * @time:	time of the touch on CLOCK_MONOTONIC, in nanoseconds
+ */
+static void input_reader_queue(struct input_reader *reader, const int32_t x, const int32_t y,
+			       const uint64_t time)
+{
+	struct input_sample sample = { .x = x, .y = y, .time = time, .read = now_ns() };
+
+	if (input_ring_push(&reader->ring, &sample))
+		__atomic_store_n(&reader->samples, reader->samples + 1, __ATOMIC_RELAXED);
+	else
+		__atomic_store_n(&reader->overflows, reader->overflows + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * input_reader_full() - check whether the reader has to wait for room to queue
+ *
+ * @reader:	pointer to a valid and started input_reader struct
+ *
+ * Must only be called from the reader thread. When the ring is full, the
+ * render loop is asked to signal @reader->spacefd once it dequeued samples.
+ *
+ * Return:	true if the ring is full, false otherwise.
+ */
+static bool input_reader_full(struct input_reader *reader)
+{
+	if (!input_ring_full(&reader->ring))
+		return false;
+
+	__atomic_store_n(&reader->waiting, true, __ATOMIC_SEQ_CST);
+
+	/* Samples dequeued before the flag was seen would not signal. */
+	return input_ring_full(&reader->ring);
+}
+
+/**
+ * input_reader_pop() - dequeue a batch of samples of the reader
+ *
+ * @reader:	pointer to a valid and started input_reader struct
+ * @samples:	returns the dequeued samples, oldest first
+ * @count:	maximum number of samples to dequeue
+ *
+ * Must only be called from the render loop. The reader thread is woken if it
+ * waits for room to queue samples.
+ *
+ * Return:	the number of samples dequeued.
+ */
+static size_t input_reader_pop(struct input_reader *reader, struct input_sample *samples,
+			       const size_t count)
+{
+	size_t popped = input_ring_pop(&reader->ring, samples, count);
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (popped && __atomic_exchange_n(&reader->waiting, false, __ATOMIC_SEQ_CST))
+		eventfd_write(reader->spacefd, 1);
+
+	return popped;
+}
+
+/**
+ * input_reader_resync() - resynchronize after the kernel event buffer overran
+ *
+ * @reader:	pointer to a valid and started input_reader struct
+ * @x:		returns the current x coordinate of the touch
+ * @y:		returns the current y coordinate of the touch
+ *
+ * All events since the last SYN_REPORT are invalid after a SYN_DROPPED. The
+ * device state is synced by the backend, after which the current position is
+ * queued as a single sample, timestamped at the time of the resync.
+ */
+static void input_reader_resync(struct input_reader *reader, int32_t *x, int32_t *y)
+{
+	struct input_event event;
+
+	__atomic_store_n(&reader->resyncs, reader->resyncs + 1, __ATOMIC_RELAXED);
+
+	while (reader->input->ops->next_event(reader->input, LIBEVDEV_READ_FLAG_SYNC, &event) ==
+	       LIBEVDEV_READ_STATUS_SYNC)
+		;
+
+	reader->input->ops->fetch_abs(reader->input, ABS_X, x);
+	reader->input->ops->fetch_abs(reader->input, ABS_Y, y);
+	input_reader_queue(reader, *x, *y, now_ns());
+}
+
+/**
+ * input_reader_reconnect() - wait for a lost input device to return
+ *
+ * @reader:	pointer to a valid and started input_reader struct
+ *
+ * DEV_INPUT_EVENT is watched for new or changed event devices, each of which
+ * is offered to the backend to attach to. Devices that returned before the
+ * watch was added are found by scanning them all once the watch is in place.
+ * Until DEV_INPUT_EVENT can be watched, adding the watch is retried every
+ * INPUT_RECONNECT_RETRY_MS.
+ *
+ * Return:	0 when attached again, 1 if the thread was asked to stop, an
+ *		error code otherwise.
+ */
+static int input_reader_reconnect(struct input_reader *reader)
+{
+	struct input_dev *input = reader->input;
+	struct pollfd fds[] = {
+		{ .fd = -1, .events = POLLIN },
+		{ .fd = reader->quitfd, .events = POLLIN },
+	};
+	uint64_t lost = now_ns();
+	uint64_t elapsed;
+	int wd = -1;
+	int ret = -ENODEV;
+
+	__atomic_store_n(&reader->losses, reader->losses + 1, __ATOMIC_RELAXED);
+	printf("Input device lost, waiting for it to reconnect.\n");
+
+	fds[0].fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fds[0].fd < 0) {
+		int err = errno;
+
+		fprintf(stderr, "Unable to watch " DEV_INPUT_EVENT ": %s\n", strerror(err));
+		return -err;
+	}
+
+	while (ret) {
+		char buf[sizeof(struct inotify_event) + NAME_MAX + 1]
+			__attribute__((aligned(__alignof__(struct inotify_event))));
+		ssize_t len;
+
+		if (wd < 0) {
+			wd = inotify_add_watch(fds[0].fd, DEV_INPUT_EVENT, IN_CREATE | IN_ATTRIB);
+			if ((wd >= 0) && !input->ops->reconnect(input, reader->filter, NULL))
+				break;
+		}
+
+		if (poll(fds, ARRAY_SIZE(fds), (wd < 0) ? INPUT_RECONNECT_RETRY_MS : -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -errno;
+			fprintf(stderr, "Failed to wait for input: %s\n", strerror(-ret));
+			goto err_close;
+		}
+		if (fds[1].revents) {
+			ret = 1;
+			goto err_close;
+		}
+
+		while (ret && ((len = read(fds[0].fd, buf, sizeof(buf))) > 0)) {
+			const struct inotify_event *event;
+			char *ptr;
+
+			for (ptr = buf; ret && (ptr < buf + len); ptr += sizeof(*event) + event->len) {
+				event = (const struct inotify_event *)ptr;
+				if (event->mask & IN_IGNORED)
+					wd = -1;
+				else if (event->len &&
+					 !strncmp(EVENT_DEV_NAME, event->name, sizeof(EVENT_DEV_NAME) - 1))
+					ret = input->ops->reconnect(input, reader->filter, event->name);
+			}
+		}
+	}
+
+	elapsed = now_ns() - lost;
+	__atomic_store_n(&reader->reconnect_ns, reader->reconnect_ns + elapsed, __ATOMIC_RELAXED);
+	if (elapsed > reader->reconnect_max)
+		__atomic_store_n(&reader->reconnect_max, elapsed, __ATOMIC_RELAXED);
+	__atomic_store_n(&reader->reconnects, reader->reconnects + 1, __ATOMIC_RELAXED);
+	printf("Input device reconnected after %.3f ms.\n", (double)elapsed / NSEC_PER_MSEC);
+	ret = 0;
+
+err_close:
+	close(fds[0].fd);
+
+	return ret;
+}
+
+/**
+ * input_reader_main() - input thread main loop
+ *
+ * @arg:	pointer to the input_reader struct of the thread
+ *
+ * The thread sleeps until input events are pending and then drains the
+ * device completely. Every SYN_REPORT that changed the touch position is
+ * queued as a sample, so no intermediate positions of a swipe are lost.
+ * Events of lossless backends are left pending while the ring is full, until
+ * the render loop made room for them.
+ * When the device is lost, the thread waits for it to return, if the backend
+ * can attach to it again, and then continues reading from it.
+ *
+ * Return:	always NULL.
+ */
+static void *input_reader_main(void *arg)
+{
+	struct input_reader *reader = arg;
+	struct input_dev *input = reader->input;
+	struct pollfd fds[] = {
+		{ .fd = input->ops->get_fd(input), .events = POLLIN },
+		{ .fd = reader->quitfd, .events = POLLIN },
+		{ .fd = reader->spacefd, .events = POLLIN },
+	};
+	bool lossless = input->ops->lossless && input->ops->lossless(input);
+	int32_t x = 0, y = 0;
+	bool moved = false;
+	bool full = false;
+	int ret = -ENODEV;
+
+	input->ops->fetch_abs(input, ABS_X, &x);
+	input->ops->fetch_abs(input, ABS_Y, &y);
+
+	for (;;) {
+		uint32_t head = reader->ring.head;
+		struct input_event event;
+
+		if (poll(fds, ARRAY_SIZE(fds), -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -errno;
+			fprintf(stderr, "Failed to wait for input: %s\n", strerror(-ret));
+			break;
+		}
+		if (fds[1].revents)
+			return NULL;
+		if (fds[2].revents) {
+			eventfd_t count;
+
+			eventfd_read(reader->spacefd, &count);
+		}
+
+		do {
+			full = lossless && input_reader_full(reader);
+			if (full) {
+				ret = -EAGAIN;
+				break;
+			}
+			ret = input->ops->next_event(input, LIBEVDEV_READ_FLAG_NORMAL, &event);
+			if (ret == LIBEVDEV_READ_STATUS_SYNC) {
+				input_reader_resync(reader, &x, &y);
+				moved = false;
+			} else if (ret == LIBEVDEV_READ_STATUS_SUCCESS) {
+				if (libevdev_event_is_code(&event, EV_ABS, ABS_X)) {
+					x = event.value;
+					moved = true;
+				} else if (libevdev_event_is_code(&event, EV_ABS, ABS_Y)) {
+					y = event.value;
+					moved = true;
+				} else if (libevdev_event_is_code(&event, EV_SYN, SYN_REPORT) && moved) {
+					input_reader_queue(reader, x, y,
+							   (event.input_event_sec * NSEC_PER_SEC) +
+							   (event.input_event_usec * NSEC_PER_USEC));
+					moved = false;
+				}
+			}
+		} while (ret >= 0);
+		fds[0].events = full ? 0 : POLLIN;
+
+		if (reader->ring.head != head)
+			eventfd_write(reader->notifyfd, 1);
+
+		if ((ret == -EAGAIN) && (fds[0].revents & (POLLERR | POLLHUP)))
+			ret = -ENODEV;
+		if ((ret == -ENODEV) && input->ops->reconnect) {
+			ret = input_reader_reconnect(reader);
+			if (ret > 0)
+				return NULL;
+			if (ret)
+				break;
+
+			fds[0].fd = input->ops->get_fd(input);
+			input->ops->fetch_abs(input, ABS_X, &x);
+			input->ops->fetch_abs(input, ABS_Y, &y);
+			moved = false;
+			continue;
+		}
+		if (ret != -EAGAIN)
+			break;
+	}
+
+	__atomic_store_n(&reader->error, ret, __ATOMIC_RELEASE);
+	eventfd_write(reader->notifyfd, 1);
+
+	return NULL;
+}
+
+/**
+ * input_reader_start() - start reading input events on a separate thread
+ *
+ * @reader:	input_reader structure to initialize
+ * @input:	pointer to a valid and initialized input_dev struct
+ * @filter:	input devices to attach to again after @input was lost
+ *
+ * Note that @input may not be used by the caller until input_reader_stop() is
+ * called.
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int input_reader_start(struct input_reader *reader, struct input_dev *input,
+			      const struct input_filter *filter)
+{
+	int ret;
+
+	memset(reader, 0, sizeof(*reader));
+	reader->input = input;
+	reader->filter = filter;
+	reader->quitfd = -1;
+	reader->spacefd = -1;
+
+	reader->notifyfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (reader->notifyfd < 0) {
+		int err = errno;
+
+		fprintf(stderr, "Unable to create input notifier: %s\n", strerror(err));
+		return -err;
+	}
+
+	reader->quitfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (reader->quitfd < 0) {
+		ret = -errno;
+		fprintf(stderr, "Unable to create input notifier: %s\n", strerror(-ret));
+		goto err_close;
+	}
+
+	reader->spacefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (reader->spacefd < 0) {
+		ret = -errno;
+		fprintf(stderr, "Unable to create input notifier: %s\n", strerror(-ret));
+		goto err_close;
+	}
+
+	ret = pthread_create(&reader->thread, NULL, input_reader_main, reader);
+	if (ret) {
+		fprintf(stderr, "Unable to start input thread: %s\n", strerror(ret));
+		ret = -ret;
+		goto err_close;
+	}
+
+	return 0;
+
+err_close:
+	if (reader->spacefd >= 0)
+		close(reader->spacefd);
+	if (reader->quitfd >= 0)
+		close(reader->quitfd);
+	close(reader->notifyfd);
+	reader->spacefd = -1;
+	reader->quitfd = -1;
+	reader->notifyfd = -1;
+
+	return ret;
+}
+
+/**
+ * input_reader_stop() - stop the input thread
+ *
+ * @reader:	input_reader structure to clean up
+ */
+static void input_reader_stop(struct input_reader *reader)
+{
+	if (reader->notifyfd < 0)
+		return;
+
+	eventfd_write(reader->quitfd, 1);
+	pthread_join(reader->thread, NULL);
+
+	close(reader->spacefd);
+	close(reader->quitfd);
+	close(reader->notifyfd);
+	reader->spacefd = -1;
+	reader->quitfd = -1;
+	reader->notifyfd = -1;
+}
+
+/**
+ * input_reader_report() - print the input statistics
+ *
+ * @reader:	pointer to a valid and started input_reader struct
+ */
+static void input_reader_report(const struct input_reader *reader)
+{
+	uint64_t losses = __atomic_load_n(&reader->losses, __ATOMIC_RELAXED);
+	uint64_t reconnects = __atomic_load_n(&reader->reconnects, __ATOMIC_RELAXED);
+
+	printf("Input: %" PRIu64 " samples, %" PRIu64 " dropped on queue overflow, %" PRIu64 " resyncs after event buffer overrun\n",
+	       __atomic_load_n(&reader->samples, __ATOMIC_RELAXED),
+	       __atomic_load_n(&reader->overflows, __ATOMIC_RELAXED),
+	       __atomic_load_n(&reader->resyncs, __ATOMIC_RELAXED));
+
+	if (losses)
+		printf("Reconnects: %" PRIu64 " of %" PRIu64 " losses, latency mean %.3f ms, max %.3f ms\n",
+		       reconnects, losses,
+		       reconnects ? (double)__atomic_load_n(&reader->reconnect_ns, __ATOMIC_RELAXED) /
+				    reconnects / NSEC_PER_MSEC : 0.0,
+		       (double)__atomic_load_n(&reader->reconnect_max, __ATOMIC_RELAXED) / NSEC_PER_MSEC);
+}
+
+/**
+ * enum loop_source - event sources of the render loop
+ *
+ * @LOOP_INPUT:		touch samples are queued or the input device was lost
+ * @LOOP_FRAME:		the next frame is due
+ * @LOOP_SIGNAL:	a termination signal was received
+ */
+enum loop_source {
+	LOOP_INPUT,
+	LOOP_FRAME,
+	LOOP_SIGNAL,
+};
+
+/**
+ * loop_add() - add an event source to the render loop
+ *
+ * @epfd:	epoll file descriptor of the render loop
+ * @fd:		file descriptor to wait for to become readable
+ * @source:	event source identifying @fd
+ * @station:	index of the station @fd belongs to, 0 if shared
+ *
+ * The event source is kept in the lower and the station in the upper half of
+ * the epoll data.
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int loop_add(const int epfd, const int fd, const enum loop_source source,
+		    const uint32_t station)
+{
+	struct epoll_event ev = { 0 };
+
+	ev.events = EPOLLIN;
+	ev.data.u64 = ((uint64_t)station << 32) | source;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		int err = errno;
+
+		fprintf(stderr, "Unable to watch event source %u: %s\n", source, strerror(err));
+		return -err;
+	}
+
+	return 0;
+}
+
+/**
+ * struct frame_sched - frame scheduler on absolute monotonic deadlines
+ *
+ * @timerfd:	timer file descriptor armed at @deadline
+ * @period:	frame period in nanoseconds
+ * @deadline:	absolute CLOCK_MONOTONIC time the current frame is due
+ * @start:	time the scheduler was started
+ * @frames:	number of frames rendered
+ * @missed:	number of frame deadlines that passed without rendering a frame
+ * @elided:	number of frames not rendered as they would not have changed
+ * @skipped:	number of frame deadlines before @deadline that are slept through
+ * @frame_time:	histogram of the time spent rendering a frame, in nanoseconds
+ * @wakeup:	histogram of the time from a deadline until the loop woke up for
+ *		it, in nanoseconds
+ */
+struct frame_sched {
+	int timerfd;
+	uint64_t period;
+	uint64_t deadline;
+	uint64_t start;
+	uint64_t frames;
+	uint64_t missed;
+	uint64_t elided;
+	uint32_t skipped;
+	struct histogram frame_time;
+	struct histogram wakeup;
+};
+
+/**
+ * frame_sched_arm() - arm the frame timer at the current deadline
+ *
+ * @sched:	pointer to a valid and initialized frame_sched struct
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int frame_sched_arm(struct frame_sched *sched)
+{
+	struct itimerspec its = { 0 };
+
+	its.it_value.tv_sec = sched->deadline / NSEC_PER_SEC;
+	its.it_value.tv_nsec = sched->deadline % NSEC_PER_SEC;
+	if (timerfd_settime(sched->timerfd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+		int err = errno;
+
+		fprintf(stderr, "Unable to arm frame timer: %s\n", strerror(err));
+		return -err;
+	}
+
+	return 0;
+}
+
+/**
+ * frame_sched_open() - create and start a frame scheduler
+ *
+ * @sched:	frame_sched structure to initialize
+ * @fps:	framerate in Hz to schedule frames at
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int frame_sched_open(struct frame_sched *sched, const uint32_t fps)
+{
+	memset(sched, 0, sizeof(*sched));
+	hist_reset(&sched->frame_time);
+	hist_reset(&sched->wakeup);
+	sched->period = FRAME_PERIOD_NS(fps);
+
+	sched->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (sched->timerfd < 0) {
+		int err = errno;
+
+		fprintf(stderr, "Unable to create frame timer: %s\n", strerror(err));
+		return -err;
+	}
+
+	sched->start = now_ns();
+	sched->deadline = sched->start + sched->period;
+
+	return frame_sched_arm(sched);
+}
+
+/**
+ * frame_sched_begin() - start rendering the frame that is due
+ *
+ * @sched:	pointer to a valid and initialized frame_sched struct
+ * @begin:	returns the time rendering of the frame started
+ *
+ * When waking up later than one or more whole frame periods, the frames that
+ * could not be rendered in time are skipped rather than rendered back to back,
+ * and counted as missed. Frames slept through by frame_sched_elide() are
+ * counted as elided instead. How late the loop woke up for the deadline is
+ * recorded as the scheduling noise of the tester itself.
+ *
+ * Return:	the number of frame periods elapsed since the previous frame.
+ */
+static uint32_t frame_sched_begin(struct frame_sched *sched, uint64_t *begin)
+{
+	uint64_t expirations;
+	uint64_t late;
+	uint32_t skipped;
+
+	if (read(sched->timerfd, &expirations, sizeof(expirations)) < 0)
+		return 0;
+
+	*begin = now_ns();
+	hist_add(&sched->wakeup, (*begin > sched->deadline) ? *begin - sched->deadline : 0);
+	late = (*begin > sched->deadline) ? (*begin - sched->deadline) / sched->period : 0;
+	sched->missed += late;
+	sched->deadline += late * sched->period;
+
+	skipped = sched->skipped;
+	sched->elided += skipped;
+	sched->skipped = 0;
+
+	return late + skipped + 1;
+}
+
+/**
+ * frame_sched_end() - finish the current frame and schedule the next one
+ *
+ * @sched:	pointer to a valid and initialized frame_sched struct
+ * @begin:	time the frame was started, as returned by frame_sched_begin()
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int frame_sched_end(struct frame_sched *sched, const uint64_t begin)
+{
+	hist_add(&sched->frame_time, now_ns() - begin);
+	sched->frames++;
+	sched->deadline += sched->period;
+
+	return frame_sched_arm(sched);
+}
+
+/**
+ * frame_sched_elide() - skip the current frame and sleep through the next ones
+ *
+ * @sched:	pointer to a valid and initialized frame_sched struct
+ * @periods:	number of frame periods until the next frame could change
+ *
+ * Called instead of frame_sched_end() when the frame would be unchanged. The
+ * timer is armed @periods frames ahead, so the loop only wakes up earlier if
+ * frame_sched_wake() is called.
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int frame_sched_elide(struct frame_sched *sched, const uint32_t periods)
+{
+	sched->elided++;
+	sched->skipped = periods - 1;
+	sched->deadline += periods * sched->period;
+
+	return frame_sched_arm(sched);
+}
+
+/**
+ * frame_sched_passed() - count the slept through frame deadlines passed
+ *
+ * @sched:	pointer to a valid and initialized frame_sched struct
+ * @now:	current time on CLOCK_MONOTONIC, in nanoseconds
+ *
+ * Return:	the number of frame deadlines slept through that passed by @now.
+ */
+static uint32_t frame_sched_passed(const struct frame_sched *sched, const uint64_t now)
+{
+	uint64_t first = sched->deadline - (sched->skipped * sched->period);
+	uint64_t passed;
+
+	if (now < first)
+		return 0;
+
+	passed = ((now - first) / sched->period) + 1;
+
+	return (passed < sched->skipped) ? passed : sched->skipped;
+}
+
+/**
+ * frame_sched_wake() - render a frame at the next deadline after all
+ *
+ * @sched:	pointer to a valid and initialized frame_sched struct
+ *
+ * Cuts short sleeping through frames after frame_sched_elide(), for example
+ * as input arrived. The frame is scheduled on the first frame deadline that
+ * did not pass yet, so the frames stay on their original schedule.
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int frame_sched_wake(struct frame_sched *sched)
+{
+	uint32_t passed;
+
+	if (!sched->skipped)
+		return 0;
+
+	passed = frame_sched_passed(sched, now_ns());
+	sched->deadline -= (uint64_t)(sched->skipped - passed) * sched->period;
+	sched->skipped = passed;
+
+	return frame_sched_arm(sched);
+}
+
+/**
+ * frame_sched_report() - print frame pacing statistics
+ *
+ * @sched:	pointer to a valid and initialized frame_sched struct
+ *
+ * The achieved framerate counts elided frames too, as they were on time.
+ */
+static void frame_sched_report(const struct frame_sched *sched)
+{
+	uint64_t now = now_ns();
+	uint64_t elapsed = now - sched->start;
+	uint64_t elided = sched->elided + frame_sched_passed(sched, now);
+
+	printf("Frames: %" PRIu64 " rendered, %" PRIu64 " elided, %" PRIu64 " missed deadlines, %.1f fps achieved (target %.1f fps)\n",
+	       sched->frames, elided, sched->missed,
+	       elapsed ? ((sched->frames + elided) * (double)NSEC_PER_SEC) / elapsed : 0.0,
+	       (double)NSEC_PER_SEC / sched->period);
+	hist_print("Frame time", &sched->frame_time);
+	hist_print("Wake-up latency during test", &sched->wakeup);
+}
+
+/**
+ * struct latency_stamp - timestamps of a touch sample on its way to the display
+ *
+ * @time:	time of the input event, in nanoseconds
+ * @read:	time the input event was read by the input thread, in nanoseconds
+ */
+struct latency_stamp {
+	uint64_t time;
+	uint64_t read;
+};
+
+/**
+ * struct latency_stats - touch to photon latency measurement
+ *
+ * @input:		delay from the input event until read by the input thread
+ * @display:		delay from read by the input thread until presented
+ * @total:		delay from the input event until presented
+ * @marked:		timestamps of the samples marked since the last compose
+ * @marked_count:	number of timestamps in @marked
+ * @composed:		timestamps of the samples in the frame to be presented
+ * @composed_count:	number of timestamps in @composed
+ * @untracked:		number of samples not measured as too many were pending
+ *
+ * The input event is timestamped by the kernel when the driver handles the
+ * report of the digitiser, so @input covers the driver and the input path,
+ * while @display covers the rendering and the display path. The scan time
+ * of the digitiser and the scan-out of the panel are not included.
+ */
+struct latency_stats {
+	struct histogram input;
+	struct histogram display;
+	struct histogram total;
+	struct latency_stamp marked[INPUT_RING_SIZE];
+	size_t marked_count;
+	struct latency_stamp composed[INPUT_RING_SIZE];
+	size_t composed_count;
+	uint64_t untracked;
+};
+
+/**
+ * latency_init() - initialize touch to photon latency measurement
+ *
+ * @stats:	latency_stats structure to initialize
+ */
+static void latency_init(struct latency_stats *stats)
+{
+	hist_reset(&stats->input);
+	hist_reset(&stats->display);
+	hist_reset(&stats->total);
+	stats->marked_count = 0;
+	stats->composed_count = 0;
+	stats->untracked = 0;
+}
+
+/**
+ * latency_mark() - track a sample marked into the input mask
+ *
+ * @stats:	pointer to a valid and initialized latency_stats struct
+ * @sample:	sample that was marked
+ */
+static void latency_mark(struct latency_stats *stats, const struct input_sample *sample)
+{
+	if (stats->marked_count >= ARRAY_SIZE(stats->marked)) {
+		stats->untracked++;
+		return;
+	}
+
+	stats->marked[stats->marked_count].time = sample->time;
+	stats->marked[stats->marked_count].read = sample->read;
+	stats->marked_count++;
+}
+
+/**
+ * latency_compose() - track the marked samples as composed into the frame
+ *
+ * @stats:	pointer to a valid and initialized latency_stats struct
+ */
+static void latency_compose(struct latency_stats *stats)
+{
+	size_t room = ARRAY_SIZE(stats->composed) - stats->composed_count;
+	size_t count = (stats->marked_count < room) ? stats->marked_count : room;
+
+	memcpy(&stats->composed[stats->composed_count], stats->marked,
+	       count * sizeof(*stats->marked));
+	stats->composed_count += count;
+	stats->untracked += stats->marked_count - count;
+	stats->marked_count = 0;
+}
+
+/**
+ * latency_present() - record the latency of the samples in a presented frame
+ *
+ * @stats:	pointer to a valid and initialized latency_stats struct
+ * @now:	time the frame was presented, in nanoseconds
+ */
+static void latency_present(struct latency_stats *stats, const uint64_t now)
+{
+	size_t i;
+
+	for (i = 0; i < stats->composed_count; i++) {
+		const struct latency_stamp *stamp = &stats->composed[i];
+
+		hist_add(&stats->input, (stamp->read > stamp->time) ? stamp->read - stamp->time : 0);
+		hist_add(&stats->display, (now > stamp->read) ? now - stamp->read : 0);
+		hist_add(&stats->total, (now > stamp->time) ? now - stamp->time : 0);
+	}
+	stats->composed_count = 0;
+}
+
+/**
+ * latency_report() - print the touch to photon latency statistics
+ *
+ * @stats:	pointer to a valid and initialized latency_stats struct
+ */
+static void latency_report(const struct latency_stats *stats)
+{
+	printf("Latency: %" PRIu64 " touches presented, %" PRIu64 " untracked\n",
+	       stats->total.count, stats->untracked);
+	hist_print("Touch to photon", &stats->total);
+	hist_print("Input (event to read)", &stats->input);
+	hist_print("Display (read to presented)", &stats->display);
+}
+
+/**
+ * latency_check() - check the latency results against the scheduling noise
+ *
+ * @stats:	pointer to a valid and initialized latency_stats struct
+ * @noise:	histogram of the wake-up latency of the tester, in nanoseconds
+ *
+ * The touch to photon latency can only be trusted if the tester itself wakes
+ * up for its frames in less time than it takes, a warning is printed if not.
+ */
+static void latency_check(const struct latency_stats *stats, const struct histogram *noise)
+{
+	uint64_t latency = hist_percentile(&stats->total, 50);
+
+	if (!stats->total.count || (hist_percentile(noise, 99) < latency))
+		return;
+
+	printf("Warning: wake-up latency p99 %.3f ms is not below touch to photon p50 %.3f ms, latency results are unreliable\n",
+	       hist_percentile(noise, 99) / (double)NSEC_PER_MSEC,
+	       latency / (double)NSEC_PER_MSEC);
+}
+
+/**
+ * signal_open() - redirect termination signals to a file descriptor
+ *
+ * SIGINT (ctrl-c etc) and SIGTERM are blocked for regular delivery and made
+ * available through a signalfd instead, so that the renderloop can handle them
+ * in between frames and cleanup. SIGUSR1 is handled likewise to request the
+ * statistics gathered so far.
+ *
+ * Return:	a signalfd file descriptor on success, an error code otherwise.
+ */
+static int signal_open(void)
+{
+	sigset_t mask;
+	int fd;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR1);
+	if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
+		int err = errno;
+
+		fprintf(stderr, "Unable to block signals: %s\n", strerror(err));
+		return -err;
+	}
+
+	fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd < 0) {
+		int err = errno;
+
+		fprintf(stderr, "Unable to create signal handler: %s\n", strerror(err));
+		return -err;
+	}
+
+	return fd;
+}
+
+/**
+ * jitter_measure() - measure the wake-up latency of the calling thread
+ *
+ * @hist:	histogram to record the wake-up latencies into, in nanoseconds
+ * @duration:	time to measure for, in nanoseconds
+ *
+ * Like cyclictest, the thread sleeps until absolute deadlines
+ * JITTER_INTERVAL_NS apart and records how late it woke up for every one.
+ */
+static void jitter_measure(struct histogram *hist, const uint64_t duration)
+{
+	uint64_t deadline = now_ns();
+	uint64_t end = deadline + duration;
+
+	hist_reset(hist);
+	while (deadline < end) {
+		struct timespec ts;
+		uint64_t now;
+
+		deadline += JITTER_INTERVAL_NS;
+		ts.tv_sec = deadline / NSEC_PER_SEC;
+		ts.tv_nsec = deadline % NSEC_PER_SEC;
+		if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+			continue;
+
+		now = now_ns();
+		hist_add(hist, (now > deadline) ? now - deadline : 0);
+	}
+}
+
+/**
+ * realtime_init() - set up deterministic scheduling of the tester
+ *
+ * @opts:	command line options of the test
+ *
+ * The calling thread is pinned to the CPUs of --cpus, if any. With --realtime,
+ * all memory of the process is locked and the thread is scheduled SCHED_FIFO at
+ * the requested priority, after which its wake-up latency is measured for
+ * JITTER_SELFTEST_NS, as the scheduling noise to judge latency results by.
+ * Threads started afterwards, such as the input readers and render workers,
+ * inherit the affinity and scheduling policy, so this must be called before
+ * any thread is started.
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int realtime_init(const struct options *opts)
+{
+	struct sched_param param = { .sched_priority = opts->realtime };
+	struct histogram jitter;
+
+	if (CPU_COUNT(&opts->cpus) && sched_setaffinity(0, sizeof(opts->cpus), &opts->cpus)) {
+		int err = errno;
+
+		fprintf(stderr, "Unable to set CPU affinity: %s\n", strerror(err));
+		return -err;
+	}
+	if (!opts->realtime)
+		return 0;
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+		int err = errno;
+
+		fprintf(stderr, "Unable to lock memory: %s\n", strerror(err));
+		return -err;
+	}
+	if (sched_setscheduler(0, SCHED_FIFO, &param)) {
+		int err = errno;
+
+		fprintf(stderr, "Unable to set SCHED_FIFO priority %u: %s\n",
+			opts->realtime, strerror(err));
+		return -err;
+	}
+
+	printf("Real-time scheduling at SCHED_FIFO priority %u.\n", opts->realtime);
+	jitter_measure(&jitter, JITTER_SELFTEST_NS);
+	hist_print("Wake-up latency before test", &jitter);
+
+	return 0;
+}
+
+/**
+ * struct station - a display and touch screen pair under test
+ *
+ * @disp:	display of the station
+ * @input:	touch screen of the station
+ * @filter:	input devices the station attaches to, also when reconnecting
+ * @reader:	input thread reading @input
+ * @damage:	dirty tile tracking of @disp
+ * @coverage:	touch coverage of the test pattern grid of @disp
+ * @latency:	touch to photon latency statistics of the station
+ * @bands:	banded lines of @disp, NULL if banding is disabled
+ * @pipe:	render variant for the current background color
+ * @cycle:	frame periods between background color changes
+ * @elapsed:	frame periods since the background color last changed
+ * @flush:	frames left until the last input is presented, 0 if not flushing
+ * @color:	index of the background color in @background_colors
+ * @done:	whether the test of the station finished
+ *
+ * Every station is tested on its own, only the frame scheduler, the render
+ * threads and the signals are shared.
+ */
+struct station {
+	struct display_info *disp;
+	struct input_dev *input;
+	struct input_filter filter;
+	struct input_reader reader;
+	struct damage_info damage;
+	struct coverage coverage;
+	struct latency_stats *latency;
+	uint8_t *bands;
+	struct render_pipeline pipe;
+	uint32_t cycle;
+	uint32_t elapsed;
+	uint32_t flush;
+	uint8_t color;
+	bool done;
+};
+
+/**
+ * station_size() - get the space the test state of a station takes in an arena
+ *
+ * @station:	station with an opened display
+ * @opts:	command line options of the test
+ *
+ * Return:	size in bytes to reserve for station_init().
+ */
+static size_t station_size(const struct station *station, const struct options *opts)
+{
+	size_t size;
+
+	size = ARENA_SIZE(sizeof(*station->latency)) +
+	       damage_size(station->disp, opts->xsize, opts->ysize) +
+	       coverage_size(station->disp, opts->xsize, opts->ysize);
+	if (opts->banding)
+		size += band_lines_size(station->disp);
+
+	return size;
+}
+
+/**
+ * station_init() - prepare a station for its test
+ *
+ * @station:	station with an opened display and input device
+ * @arena:	arena to allocate the test state from, see station_size()
+ * @opts:	command line options of the test
+ *
+ * With several stations, the displays are not waited on for their vertical
+ * blank after a page flip. The stations present one after the other within a
+ * frame, so the waits for displays that are not in phase would add up and
+ * delay every later station. A flip still takes effect on the next vertical
+ * blank, well before the page is composed into again a frame later.
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int station_init(struct station *station, struct arena *arena,
+			const struct options *opts)
+{
+	struct display_info *disp = station->disp;
+	uint8_t *screen;
+	uint32_t row;
+	int ret;
+
+	disp_flip_init(disp);
+	/* Waiting for the vblank of one display after the other adds them up. */
+	if ((opts->station_count > 1) && disp->vsync) {
+		printf("Not waiting for vsync of '%s', testing several stations.\n", disp->id);
+		disp->vsync = false;
+	}
+	screen = (disp->pages > 1) ? disp_page(disp, disp->page) : disp->fb + disp->offset;
+	for (row = 0; row < disp->yres; row++)
+		memset(screen + (row * disp->line_length), 0x00, disp->xres * disp->bpp);
+
+	if (opts->banding)
+		station->bands = band_lines_init(disp, arena);
+	station->latency = arena_alloc(arena, sizeof(*station->latency));
+	if (station->latency)
+		latency_init(station->latency);
+	ret = damage_init(&station->damage, arena, disp, opts->xsize, opts->ysize);
+	if (!ret)
+		ret = coverage_init(&station->coverage, arena, disp, opts->xsize, opts->ysize);
+	if ((opts->banding && !station->bands) || !station->latency || ret)
+		return -ENOMEM;
+
+	render_pipeline_select(&station->pipe, disp, station->bands, station->color, opts->fade);
+
+	return 0;
+}
+
+/**
+ * station_input() - handle a notification of the input thread of a station
+ *
+ * @station:	pointer to a valid and initialized station struct
+ *
+ * Return:	0 on success, an error code if the input device was lost.
+ */
+static int station_input(struct station *station)
+{
+	eventfd_t count;
+	int error;
+
+	if (eventfd_read(station->reader.notifyfd, &count) < 0)
+		return 0;
+
+	error = __atomic_load_n(&station->reader.error, __ATOMIC_ACQUIRE);
+	if ((error == -ENODATA) && !station->flush) {
+		printf("Input finished.\n");
+		station->flush = INPUT_FLUSH_FRAMES;
+	} else if (error && (error != -ENODATA)) {
+		fprintf(stderr, "Input device lost.\n");
+		return -ENODEV;
+	}
+
+	return 0;
+}
+
+/**
+ * station_passed() - check whether the test of a station passed
+ *
+ * @station:	pointer to a valid and initialized station struct
+ *
+ * Return:	true if every cell of the test pattern was touched at least once
+ *		and the input device was never lost for good, false otherwise.
+ */
+static bool station_passed(const struct station *station)
+{
+	int error = __atomic_load_n(&station->reader.error, __ATOMIC_ACQUIRE);
+
+	return station->coverage.passes && (!error || (error == -ENODATA));
+}
+
+/**
+ * station_cycle() - check whether a frame changes the background color
+ *
+ * @station:	pointer to a valid and initialized station struct
+ * @periods:	number of frame periods elapsed since the previous frame
+ *
+ * The periods of frames that were elided or missed count as well.
+ *
+ * Return:	true if the background color changes on the frame, false otherwise.
+ */
+static bool station_cycle(const struct station *station, const uint32_t periods)
+{
+	return (station->elapsed + periods) >= station->cycle;
+}
+
+/**
+ * station_idle() - check whether the next frame of a station would be unchanged
+ *
+ * @station:	pointer to a valid and initialized station struct
+ * @periods:	number of frame periods elapsed since the previous frame
+ *
+ * Return:	true if no touch samples are queued, the input mask has fully
+ *		faded, everything is presented and the background color does not
+ *		change, false otherwise.
+ */
+static bool station_idle(const struct station *station, const uint32_t periods)
+{
+	return !station->flush && !station_cycle(station, periods) &&
+	       !input_ring_pending(&station->reader.ring) && damage_idle(&station->damage);
+}
+
+/**
+ * station_cycle_due() - get the number of frames until the next color change
+ *
+ * @station:	pointer to a valid and initialized station struct
+ *
+ * Return:	the number of frame periods from the current frame until the
+ *		frame that changes the background color.
+ */
+static uint32_t station_cycle_due(const struct station *station)
+{
+	if (station->elapsed >= station->cycle)
+		return 1;
+
+	return station->cycle - station->elapsed;
+}
+
+/**
+ * station_frame() - render and present the next frame of a station
+ *
+ * @station:	pointer to a valid and initialized station struct
+ * @pool:	pointer to a valid and initialized render_pool struct
+ * @opts:	command line options of the test
+ * @periods:	number of frame periods elapsed since the previous frame
+ *
+ * All samples queued since the previous frame are applied and the damaged
+ * parts of the frame are composed straight into the framebuffer, or into the
+ * page that is flipped to next.
+ *
+ * Return:	true if the test of the station finished, false otherwise.
+ */
+static bool station_frame(struct station *station, struct render_pool *pool,
+			  const struct options *opts, const uint32_t periods)
+{
+	struct input_sample samples[INPUT_BATCH_SIZE];
+	struct display_info *disp = station->disp;
+	bool update_input = false;
+	bool bg_cycle_color;
+	bool done = false;
+	size_t count;
+
+	bg_cycle_color = station_cycle(station, periods);
+
+	while ((count = input_reader_pop(&station->reader, samples, ARRAY_SIZE(samples)))) {
+		size_t j;
+
+		for (j = 0; j < count; j++)
+			if (input_mark(&station->coverage, &station->damage, disp, samples[j].x,
+				       samples[j].y, samples[j].time, opts->xsize, opts->ysize))
+				latency_mark(station->latency, &samples[j]);
+		update_input = true;
+	}
+
+	if (update_input && coverage_check(&station->coverage) && opts->abort)
+		done = true;
+
+	if (bg_cycle_color) {
+		station->color = (station->color + 1) % ARRAY_SIZE(background_colors);
+		station->damage.full = true;
+		render_pipeline_select(&station->pipe, disp, station->bands, station->color,
+				       opts->fade);
+	}
+
+	damage_compose(&station->damage, pool, disp_target(disp), disp, &station->pipe);
+	latency_compose(station->latency);
+	damage_present(&station->damage, disp);
+	latency_present(station->latency, now_ns());
+
+	if (bg_cycle_color)
+		station->elapsed = 0;
+	else
+		station->elapsed += periods;
+
+	if (station->flush && !--station->flush)
+		done = true;
+
+	return done;
+}
+
+/**
+ * station_report() - print the input, latency and coverage of a station
+ *
+ * @station:	pointer to a valid and initialized station struct
+ * @index:	index of the station
+ * @count:	number of stations under test
+ * @opts:	command line options of the test
+ * @noise:	histogram of the wake-up latency of the tester, in nanoseconds
+ * @finished:	whether the test finished, to report the coverage as well
+ */
+static void station_report(const struct station *station, const size_t index,
+			   const size_t count, const struct options *opts,
+			   const struct histogram *noise, const bool finished)
+{
+	char *path;
+
+	if (count > 1)
+		printf("Station %zu (%s):\n", index, station->disp->id);
+	input_reader_report(&station->reader);
+	latency_report(station->latency);
+	latency_check(station->latency, noise);
+	if (!finished)
+		return;
+
+	coverage_report(&station->coverage);
+	if (!opts->coverage)
+		return;
+
+	if (count == 1) {
+		coverage_save(&station->coverage, opts->coverage, opts->xsize, opts->ysize);
+	} else if (asprintf(&path, "%s.%zu", opts->coverage, index) >= 0) {
+		coverage_save(&station->coverage, path, opts->xsize, opts->ysize);
+		free(path);
+	}
+}
+
+/**
+ * renderloop() - main render loop and input handling
+ *
+ * @stations:	stations with an opened display and input device each
+ * @count:	number of elements in @stations
+ * @opts:	command line options of the test
+ *
+ * This function takes the supplied parameters and uses these to render the
+ * main application to the display of every station. The input itself is
+ * rendered into a buffer and then inverts the main background. This so that
+ * the test pattern remains visible after it has been asserted. Input events
+ * are drained by a separate input thread per station, which queues every
+ * touch sample. The mainloop sleeps until a frame is due at the framerate, on
+ * which every station applies the samples queued since its previous frame and
+ * composes the damaged parts of its frame, see station_frame(). Every frame
+ * thus shows all touches up to the moment it was started, and a station that
+ * is not touched costs little more than a pass over its tile grid. While no
+ * station would change its frame, no frame is rendered at all and the loop
+ * sleeps until the next background color change, or until touch samples are
+ * queued, on which rendering resumes at the next frame deadline.
+ *
+ * The latency from every touch until the frame showing it is presented is
+ * measured. While a lost input device is attached to again, the test keeps
+ * running, so its coverage and statistics survive the reconnect. When an input
+ * script finishes, the test of the station ends once its last samples are
+ * presented, INPUT_FLUSH_FRAMES frames later. The test ends when the tests of
+ * all stations ended. The time from the start of the program until the first
+ * frame is presented is printed, as it bounds how quickly a test station is
+ * ready after boot. The buffers of all stations are carved from a single
+ * pre-faulted arena, so the first frames do not stall on page faults. Frames
+ * are rendered in horizontal stripes on multiple threads in parallel. Frame
+ * pacing, input and latency statistics are printed when the test finishes or on
+ * SIGUSR1, as is the coverage of the test pattern grid, with a heat map of the
+ * touches, when the test finishes.
+ *
+ * Return:	0 if every station passed, 1 if a station did not complete a pass
+ *		of its test pattern, an error code otherwise, such as when an
+ *		input device was lost.
+ */
+static int renderloop(struct station *stations, const size_t count,
+		      const struct options *opts)
+{
+	bool stop = false;
+	bool presented = false;
+	struct render_pool pool;
+	bool pool_started = false;
+	struct frame_sched sched = { .timerfd = -1 };
+	struct arena arena = { 0 };
+	size_t active = count;
+	int epfd = -1, sigfd = -1;
+	size_t size = 0;
+	size_t i;
+	int ret = 0;
+
+	for (i = 0; i < count; i++)
+		stations[i].reader.notifyfd = -1;
+
+	for (i = 0; i < count; i++)
+		size += station_size(&stations[i], opts);
+	ret = arena_init(&arena, size, opts->lock);
+	if (ret)
+		goto err_free;
+
+	for (i = 0; i < count; i++) {
+		ret = station_init(&stations[i], &arena, opts);
+		if (ret)
+			goto err_free;
+	}
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		ret = -errno;
+		fprintf(stderr, "Unable to create event loop: %s\n", strerror(-ret));
+		goto err_free;
+	}
+
+	ret = frame_sched_open(&sched, opts->framerate);
+	if (ret)
+		goto err_free;
+
+	/* The background color changes every DISPLAY_BG_CYCLE_NS at any framerate. */
+	for (i = 0; i < count; i++) {
+		stations[i].cycle = DISPLAY_BG_CYCLE_NS / sched.period;
+		if (!stations[i].cycle)
+			stations[i].cycle = 1;
+	}
+
+	sigfd = signal_open();
+	if (sigfd < 0) {
+		ret = sigfd;
+		goto err_free;
+	}
+
+	/* Started after blocking the signals, so the workers inherit the mask. */
+	ret = render_pool_init(&pool, opts->threads);
+	pool_started = true;
+	if (pool.nworkers)
+		printf("Rendering frames in %u stripes\n", pool.stripes);
+	for (i = 0; !ret && (i < count); i++) {
+		ret = input_reader_start(&stations[i].reader, stations[i].input, &stations[i].filter);
+		if (!ret)
+			ret = loop_add(epfd, stations[i].reader.notifyfd, LOOP_INPUT, i);
+	}
+	if (!ret)
+		ret = loop_add(epfd, sched.timerfd, LOOP_FRAME, 0);
+	if (!ret)
+		ret = loop_add(epfd, sigfd, LOOP_SIGNAL, 0);
+	if (ret)
+		goto err_free;
+
+	while (!stop) {
+		struct epoll_event events[count + LOOP_SIGNAL];
+		int nevents;
+		int j;
+
+		nevents = epoll_wait(epfd, events, ARRAY_SIZE(events), -1);
+		if (nevents < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -errno;
+			fprintf(stderr, "Failed to wait for events: %s\n", strerror(-ret));
+			break;
+		}
+
+		for (j = 0; j < nevents; j++) {
+			struct station *station = &stations[events[j].data.u64 >> 32];
+
+			switch ((uint32_t)events[j].data.u64) {
+			case LOOP_INPUT:
+				if (station_input(station) && !station->done) {
+					ret = -ENODEV;
+					station->done = true;
+					active--;
+				}
+				if (frame_sched_wake(&sched)) {
+					ret = -EIO;
+					stop = true;
+				}
+				break;
+			case LOOP_FRAME: {
+				uint32_t periods, due = UINT32_MAX;
+				uint64_t begin;
+
+				periods = frame_sched_begin(&sched, &begin);
+				if (!periods)
+					break;
+
+				/* Sleep until the next color change if no frame would change. */
+				for (i = 0; i < count; i++)
+					if (!stations[i].done && !station_idle(&stations[i], periods))
+						break;
+				if (i == count) {
+					for (i = 0; i < count; i++) {
+						if (stations[i].done)
+							continue;
+						stations[i].elapsed += periods;
+						if (station_cycle_due(&stations[i]) < due)
+							due = station_cycle_due(&stations[i]);
+					}
+					if (frame_sched_elide(&sched, due)) {
+						ret = -EIO;
+						stop = true;
+					}
+					break;
+				}
+
+				for (i = 0; i < count; i++) {
+					if (stations[i].done)
+						continue;
+					if (station_frame(&stations[i], &pool, opts, periods)) {
+						stations[i].done = true;
+						active--;
+					}
+				}
+
+				if (!presented) {
+					printf("Time to first frame: %.3f ms\n",
+					       (double)(now_ns() - opts->start) / NSEC_PER_MSEC);
+					presented = true;
+				}
+
+				if (frame_sched_end(&sched, begin)) {
+					ret = -EIO;
+					stop = true;
+				}
+				break;
+			}
+			case LOOP_SIGNAL: {
+				struct signalfd_siginfo info;
+
+				if (read(sigfd, &info, sizeof(info)) != sizeof(info))
+					break;
+
+				if (info.ssi_signo == SIGUSR1) {
+					frame_sched_report(&sched);
+					for (i = 0; i < count; i++)
+						station_report(&stations[i], i, count, opts, &sched.wakeup, false);
+				} else {
+					stop = true;
+				}
+				break;
+			}
+			}
+		}
+
+		if (!active)
+			stop = true;
+	}
+
+	printf("\nTest finished.\n");
+	frame_sched_report(&sched);
+	for (i = 0; i < count; i++)
+		station_report(&stations[i], i, count, opts, &sched.wakeup, true);
+	for (i = 0; i < count; i++) {
+		bool passed = station_passed(&stations[i]);
+
+		if (count > 1)
+			printf("Station %zu: %s\n", i, passed ? "passed" : "failed");
+		if (!passed && !ret)
+			ret = 1;
+	}
+
+	for (i = 0; i < count; i++)
+		if (stations[i].disp->page)
+			disp_flip(stations[i].disp, 0);
+
+err_free:
+	for (i = 0; i < count; i++)
+		input_reader_stop(&stations[i].reader);
+	if (pool_started)
+		render_pool_free(&pool);
+	if (sigfd >= 0)
+		close(sigfd);
+	if (sched.timerfd >= 0)
+		close(sched.timerfd);
+	if (epfd >= 0)
+		close(epfd);
+	arena_free(&arena);
+
+	return ret;
+}
+
+/**
+ * struct running_stat - streaming statistics of a series of values
+ *
+ * @count:	number of values
+ * @mean:	mean of the values
+ * @m2:		sum of the squared differences from @mean
+ * @min:	smallest value
+ * @max:	largest value
+ *
+ * Uses Welford's algorithm, which keeps the variance numerically stable over
+ * very long runs without storing any of the values.
+ */
+struct running_stat {
+	uint64_t count;
+	double mean;
+	double m2;
+	double min;
+	double max;
+};
+
+/**
+ * running_add() - add a value to a running_stat series
+ *
+ * @stat:	series to add to
+ * @val:	value to add
+ */
+static void running_add(struct running_stat *stat, const double val)
+{
+	double delta = val - stat->mean;
+
+	if (!stat->count || (val < stat->min))
+		stat->min = val;
+	if (!stat->count || (val > stat->max))
+		stat->max = val;
+	stat->count++;
+	stat->mean += delta / stat->count;
+	stat->m2 += delta * (val - stat->mean);
+}
+
+/**
+ * running_stddev() - get the sample standard deviation of a running_stat series
+ *
+ * @stat:	series to query
+ *
+ * Return:	the standard deviation, 0 for less than two values.
+ */
+static double running_stddev(const struct running_stat *stat)
+{
+	return (stat->count > 1) ? sqrt(stat->m2 / (stat->count - 1)) : 0.0;
+}
+
+/**
+ * struct analyse_slot - state of a single contact of the input analyser
+ *
+ * @active:	a finger is touching
+ * @dirty:	the contact changed in the current report
+ * @x:		current x coordinate of the contact
+ * @y:		current y coordinate of the contact
+ * @last:	time of the previous report of the contact, 0 if none
+ * @contacts:	number of times a finger touched
+ * @interval:	time between consecutive reports of the contact, in ns
+ * @anchor_x:	x coordinate the current stationary period started at
+ * @anchor_y:	y coordinate the current stationary period started at
+ * @still_x:	x coordinates during the current stationary period
+ * @still_y:	y coordinates during the current stationary period
+ */
+struct analyse_slot {
+	bool active;
+	bool dirty;
+	int32_t x;
+	int32_t y;
+	uint64_t last;
+	uint64_t contacts;
+	struct running_stat interval;
+	int32_t anchor_x;
+	int32_t anchor_y;
+	struct running_stat still_x;
+	struct running_stat still_y;
+};
+
+/**
+ * struct input_analysis - streaming analysis of a touch controller
+ *
+ * @start:		time the analysis started, in nanoseconds
+ * @slots:		state of every contact
+ * @slot:		currently selected multi-touch slot
+ * @mt:			the device uses the multi-touch slot protocol
+ * @btn_touch:		the device reports BTN_TOUCH
+ * @radius:		distance a finger may move while considered stationary
+ * @events:		number of events in the current report
+ * @reports:		number of reports in the current wakeup
+ * @total_reports:	total number of reports
+ * @overruns:		number of kernel event buffer overruns
+ * @interval:		time between consecutive reports of a contact, in ns
+ * @interval_hist:	histogram of @interval
+ * @report_events:	number of events per report
+ * @wakeup_reports:	number of reports read per wakeup
+ * @reported_x:		reported x coordinates
+ * @reported_y:		reported y coordinates
+ * @noise_x:		standard deviation of x during stationary periods
+ * @noise_y:		standard deviation of y during stationary periods
+ * @spread_x:		largest x peak-to-peak spread during a stationary period
+ * @spread_y:		largest y peak-to-peak spread during a stationary period
+ * @stuck_start:	a contact was active before the analysis started
+ * @stale_releases:	number of releases of contacts that were never touched
+ *
+ * All statistics are kept in fixed memory, so that the analysis can run for
+ * as long as needed.
+ */
+struct input_analysis {
+	uint64_t start;
+	struct analyse_slot slots[ANALYSE_MAX_SLOTS];
+	int32_t slot;
+	bool mt;
+	bool btn_touch;
+	int32_t radius;
+	uint32_t events;
+	uint32_t reports;
+	uint64_t total_reports;
+	uint64_t overruns;
+	struct running_stat interval;
+	struct histogram interval_hist;
+	struct running_stat report_events;
+	struct running_stat wakeup_reports;
+	struct running_stat reported_x;
+	struct running_stat reported_y;
+	struct running_stat noise_x;
+	struct running_stat noise_y;
+	int32_t spread_x;
+	int32_t spread_y;
+	bool stuck_start;
+	uint64_t stale_releases;
+};
+
+/**
+ * analyse_still_end() - finish the stationary period of a contact
+ *
+ * @an:		pointer to a valid and initialized input_analysis struct
+ * @slot:	contact to finish the stationary period of
+ *
+ * Only periods of at least ANALYSE_STILL_MIN reports are taken into
+ * account, shorter ones are a finger passing by.
+ */
+static void analyse_still_end(struct input_analysis *an, struct analyse_slot *slot)
+{
+	if (slot->still_x.count >= ANALYSE_STILL_MIN) {
+		running_add(&an->noise_x, running_stddev(&slot->still_x));
+		running_add(&an->noise_y, running_stddev(&slot->still_y));
+		if ((slot->still_x.max - slot->still_x.min) > an->spread_x)
+			an->spread_x = slot->still_x.max - slot->still_x.min;
+		if ((slot->still_y.max - slot->still_y.min) > an->spread_y)
+			an->spread_y = slot->still_y.max - slot->still_y.min;
+	}
+
+	memset(&slot->still_x, 0, sizeof(slot->still_x));
+	memset(&slot->still_y, 0, sizeof(slot->still_y));
+}
+
+/**
+ * analyse_contact() - track a contact touching or being released
+ *
+ * @an:		pointer to a valid and initialized input_analysis struct
+ * @slot:	contact that changed
+ * @active:	whether a finger is touching
+ */
+static void analyse_contact(struct input_analysis *an, struct analyse_slot *slot,
+			    const bool active)
+{
+	if (active && !slot->active) {
+		slot->contacts++;
+		slot->last = 0;
+	} else if (!active && slot->active) {
+		analyse_still_end(an, slot);
+	} else if (!active) {
+		an->stale_releases++;
+	}
+	slot->active = active;
+	slot->dirty = true;
+}
+
+/**
+ * analyse_report() - analyse a complete report of the touch controller
+ *
+ * @an:		pointer to a valid and initialized input_analysis struct
+ * @time:	time of the report, in nanoseconds
+ *
+ * Every contact that changed in the report counts as reported, from which
+ * the report interval and stationary noise of the contact are derived.
+ * Devices without BTN_TOUCH or multi-touch slots are considered touched
+ * whenever they report a position.
+ */
+static void analyse_report(struct input_analysis *an, const uint64_t time)
+{
+	size_t i;
+
+	an->reports++;
+	an->total_reports++;
+	running_add(&an->report_events, an->events);
+	an->events = 0;
+
+	for (i = 0; i < ARRAY_SIZE(an->slots); i++) {
+		struct analyse_slot *slot = &an->slots[i];
+
+		if (!slot->dirty)
+			continue;
+		slot->dirty = false;
+
+		if (!an->mt && !an->btn_touch && !slot->active) {
+			slot->active = true;
+			slot->contacts++;
+		}
+		if (!slot->active)
+			continue;
+
+		if (slot->last && (time > slot->last)) {
+			running_add(&slot->interval, time - slot->last);
+			running_add(&an->interval, time - slot->last);
+			hist_add(&an->interval_hist, time - slot->last);
+		}
+		slot->last = time;
+
+		if (!slot->still_x.count ||
+		    (abs(slot->x - slot->anchor_x) > an->radius) ||
+		    (abs(slot->y - slot->anchor_y) > an->radius)) {
+			analyse_still_end(an, slot);
+			slot->anchor_x = slot->x;
+			slot->anchor_y = slot->y;
+		}
+		running_add(&slot->still_x, slot->x);
+		running_add(&slot->still_y, slot->y);
+	}
+}
+
+/**
+ * analyse_event() - analyse a single input event
+ *
+ * @an:		pointer to a valid and initialized input_analysis struct
+ * @event:	input event to analyse
+ */
+static void analyse_event(struct input_analysis *an, const struct input_event *event)
+{
+	struct analyse_slot *slot = NULL;
+
+	if (!an->mt)
+		slot = &an->slots[0];
+	else if ((an->slot >= 0) && (an->slot < ANALYSE_MAX_SLOTS))
+		slot = &an->slots[an->slot];
+
+	an->events++;
+
+	switch (event->type) {
+	case EV_ABS:
+		switch (event->code) {
+		case ABS_MT_SLOT:
+			an->mt = true;
+			an->slot = event->value;
+			break;
+		case ABS_MT_TRACKING_ID:
+			an->mt = true;
+			if ((an->slot >= 0) && (an->slot < ANALYSE_MAX_SLOTS))
+				analyse_contact(an, &an->slots[an->slot], event->value >= 0);
+			break;
+		case ABS_MT_POSITION_X:
+			if (slot) {
+				slot->x = event->value;
+				slot->dirty = true;
+			}
+			break;
+		case ABS_MT_POSITION_Y:
+			if (slot) {
+				slot->y = event->value;
+				slot->dirty = true;
+			}
+			break;
+		case ABS_X:
+			running_add(&an->reported_x, event->value);
+			if (!an->mt) {
+				an->slots[0].x = event->value;
+				an->slots[0].dirty = true;
+			}
+			break;
+		case ABS_Y:
+			running_add(&an->reported_y, event->value);
+			if (!an->mt) {
+				an->slots[0].y = event->value;
+				an->slots[0].dirty = true;
+			}
+			break;
+		}
+		break;
+	case EV_KEY:
+		if (event->code == BTN_TOUCH) {
+			an->btn_touch = true;
+			if (!an->mt)
+				analyse_contact(an, &an->slots[0], event->value);
+		}
+		break;
+	case EV_SYN:
+		if (event->code == SYN_REPORT)
+			analyse_report(an, (event->input_event_sec * NSEC_PER_SEC) +
+					   (event->input_event_usec * NSEC_PER_USEC));
+		break;
+	}
+}
+
+/**
+ * analyse_init() - initialize the analysis of a touch controller
+ *
+ * @an:		input_analysis structure to initialize
+ * @input:	pointer to a valid and initialized input_dev struct
+ *
+ * A finger is considered stationary while it stays within 1/ANALYSE_STILL_DIV
+ * of the range of the axes from where it came to rest, but at least within
+ * ANALYSE_STILL_RADIUS and twice the fuzz of the axes.
+ */
+static void analyse_init(struct input_analysis *an, const struct input_dev *input)
+{
+	const struct input_absinfo *info;
+	int code;
+
+	memset(an, 0, sizeof(*an));
+	hist_reset(&an->interval_hist);
+	an->start = now_ns();
+	an->radius = ANALYSE_STILL_RADIUS;
+	an->stuck_start = input->ops->touching(input);
+
+	for (code = ABS_X; code <= ABS_Y; code++) {
+		info = input->ops->abs_info(input, code);
+		if (!info)
+			continue;
+		if (((info->maximum - info->minimum) / ANALYSE_STILL_DIV) > an->radius)
+			an->radius = (info->maximum - info->minimum) / ANALYSE_STILL_DIV;
+		if ((2 * info->fuzz) > an->radius)
+			an->radius = 2 * info->fuzz;
+	}
+}
+
+/**
+ * analyse_print() - print the analysis of a touch controller
+ *
+ * @an:		pointer to a valid and initialized input_analysis struct
+ * @input:	pointer to the analysed input_dev struct
+ */
+static void analyse_print(const struct input_analysis *an, const struct input_dev *input)
+{
+	uint64_t now = now_ns();
+	uint32_t silent = 0;
+	int code;
+	size_t i;
+
+	printf("Input analysis over %.1f s: %" PRIu64 " reports, %" PRIu64 " event buffer overruns\n",
+	       (now - an->start) / (double)NSEC_PER_SEC, an->total_reports, an->overruns);
+
+	for (code = ABS_X; code <= ABS_Y; code++) {
+		const struct input_absinfo *info = input->ops->abs_info(input, code);
+		const struct running_stat *reported = (code == ABS_X) ? &an->reported_x : &an->reported_y;
+
+		printf("Axis %c: ", (code == ABS_X) ? 'X' : 'Y');
+		if (info)
+			printf("range %d..%d, resolution %d, fuzz %d, flat %d",
+			       info->minimum, info->maximum, info->resolution, info->fuzz, info->flat);
+		else
+			printf("range unknown");
+		if (reported->count)
+			printf(", reported %.0f..%.0f", reported->min, reported->max);
+		printf("\n");
+	}
+
+	printf("Report rate: %.1f Hz, interval mean %.3f ms, jitter %.3f ms, min %.3f ms, max %.3f ms\n",
+	       an->interval.mean ? NSEC_PER_SEC / an->interval.mean : 0.0,
+	       an->interval.mean / NSEC_PER_MSEC, running_stddev(&an->interval) / NSEC_PER_MSEC,
+	       an->interval.min / NSEC_PER_MSEC, an->interval.max / NSEC_PER_MSEC);
+	hist_print("Report interval", &an->interval_hist);
+	printf("Batching: %.1f events per report (max %.0f), %.1f reports per wakeup (max %.0f)\n",
+	       an->report_events.mean, an->report_events.max,
+	       an->wakeup_reports.mean, an->wakeup_reports.max);
+
+	for (i = 0; i < ARRAY_SIZE(an->slots); i++) {
+		const struct analyse_slot *slot = &an->slots[i];
+
+		if (slot->active && slot->last && ((now - slot->last) > ANALYSE_STUCK_NS))
+			silent++;
+		if (!slot->contacts)
+			continue;
+
+		printf("Contact %zu: %" PRIu64 " touches, %.1f Hz, jitter %.3f ms\n", i,
+		       slot->contacts,
+		       slot->interval.mean ? NSEC_PER_SEC / slot->interval.mean : 0.0,
+		       running_stddev(&slot->interval) / NSEC_PER_MSEC);
+	}
+
+	printf("Stationary noise: stddev X %.2f Y %.2f, peak-to-peak X %d Y %d, over %" PRIu64 " periods\n",
+	       an->noise_x.mean, an->noise_y.mean, an->spread_x, an->spread_y, an->noise_x.count);
+	printf("Stuck touch: %s at start, %" PRIu64 " releases without touch, %u contacts silent for over %llu s\n",
+	       an->stuck_start ? "active" : "none", an->stale_releases, silent,
+	       ANALYSE_STUCK_NS / NSEC_PER_SEC);
+}
+
+/**
+ * input_analyse() - analyse the behaviour of a touch controller
+ *
+ * @input:	pointer to a valid and initialized input_dev struct
+ *
+ * Reads all input events at the full rate of the device and analyses the
+ * report rate, jitter and batching of the reports, the range of the axes and
+ * the noise of a stationary finger. A contact that is already active when
+ * the analysis starts is reported as the stuck touch firmware bug, as are
+ * releases of contacts that were never touched. The analysis is printed when
+ * it is stopped and on SIGUSR1.
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int input_analyse(struct input_dev *input)
+{
+	struct input_analysis *an;
+	struct pollfd fds[2];
+	bool stop = false;
+	int ret = 0;
+	int sigfd;
+	size_t i;
+
+	an = malloc(sizeof(*an));
+	if (!an) {
+		fprintf(stderr, "Failed to allocate memory: %s\n", strerror(errno));
+		return -ENOMEM;
+	}
+	analyse_init(an, input);
+
+	sigfd = signal_open();
+	if (sigfd < 0) {
+		free(an);
+		return sigfd;
+	}
+
+	fds[0].fd = input->ops->get_fd(input);
+	fds[0].events = POLLIN;
+	fds[1].fd = sigfd;
+	fds[1].events = POLLIN;
+
+	printf("Analysing input, stop with Ctrl-C.\n");
+	while (!stop) {
+		struct input_event event;
+		int next_event;
+
+		if (poll(fds, ARRAY_SIZE(fds), -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -errno;
+			fprintf(stderr, "Failed to wait for input: %s\n", strerror(-ret));
+			break;
+		}
+
+		if (fds[1].revents) {
+			struct signalfd_siginfo info;
+
+			if (read(sigfd, &info, sizeof(info)) == sizeof(info)) {
+				if (info.ssi_signo == SIGUSR1)
+					analyse_print(an, input);
+				else
+					stop = true;
+			}
+		}
+
+		if (!fds[0].revents)
+			continue;
+
+		do {
+			next_event = input->ops->next_event(input, LIBEVDEV_READ_FLAG_NORMAL, &event);
+			if (next_event == LIBEVDEV_READ_STATUS_SYNC) {
+				an->overruns++;
+				while (input->ops->next_event(input, LIBEVDEV_READ_FLAG_SYNC, &event) ==
+				       LIBEVDEV_READ_STATUS_SYNC)
+					analyse_event(an, &event);
+				for (i = 0; i < ARRAY_SIZE(an->slots); i++)
+					an->slots[i].last = 0;
+			} else if (next_event == LIBEVDEV_READ_STATUS_SUCCESS) {
+				analyse_event(an, &event);
+			}
+		} while (next_event >= 0);
+
+		if (an->reports) {
+			running_add(&an->wakeup_reports, an->reports);
+			an->reports = 0;
+		}
+
+		if (next_event == -ENODATA) {
+			printf("Input finished.\n");
+			stop = true;
+		} else if ((next_event != -EAGAIN) || (fds[0].revents & (POLLERR | POLLHUP))) {
+			fprintf(stderr, "Input device lost.\n");
+			ret = -ENODEV;
+			stop = true;
+		}
+	}
+
+	/* Count the contacts resting at the end as well. */
+	for (i = 0; i < ARRAY_SIZE(an->slots); i++)
+		if (an->slots[i].active)
+			analyse_still_end(an, &an->slots[i]);
+
+	printf("\nAnalysis finished.\n");
+	analyse_print(an, input);
+
+	close(sigfd);
+	free(an);
+
+	return ret;
+}
+
+/**
+ * sysfs_read() - read an attribute of a device class member from sysfs
+ *
+ * @sysfs:	root of the sysfs tree
+ * @class:	device class directory below @sysfs, SYSFS_INPUT for example
+ * @name:	name of the class member, event0 for example
+ * @attr:	relative path of the attribute, bits_per_pixel for example
+ * @buf:	returns the attribute value, without the trailing newline
+ * @size:	size, in bytes, of @buf
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int sysfs_read(const char *sysfs, const char *class, const char *name,
+		      const char *attr, char *buf, const size_t size)
+{
+	char *path;
+	ssize_t len;
+	int fd;
+
+	if (asprintf(&path, "%s%s/%s/%s", sysfs, class, name, attr) < 0)
+		return -ENOMEM;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	free(path);
+	if (fd < 0)
+		return -errno;
+
+	len = read(fd, buf, size - 1);
+	close(fd);
+	if (len < 0)
+		return -errno;
+
+	while (len && (buf[len - 1] == '\n'))
+		len--;
+	buf[len] = '\0';
+
+	return 0;
+}
+
+/**
+ * evdev_close() - close an input event device opened by evdev_open()
+ *
+ * @evdev:	pointer to a valid libevdev structure
+ */
+static void evdev_close(struct libevdev *evdev)
+{
+	int fd = libevdev_get_fd(evdev);
+
+	libevdev_free(evdev);
+	close(fd);
+}
+
+/**
+ * evdev_open() - open an input event device node
+ *
+ * @path:	required parameter to a event device node path
+ *
+ * Note that the caller is responsible for calling evdev_close() when done
+ * using the returned device pointer.
+ *
+ * Return:	a valid pointer to a libevdev structure on success, NULL otherwise.
+ */
+static struct libevdev *evdev_open(const char *path)
+{
+	struct libevdev *evdev = NULL;
+	int ret = -1;
+	int fd = -1;
+
+	fd = open(path, O_RDONLY | O_NONBLOCK);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to open '%s': %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	ret = libevdev_new_from_fd(fd, &evdev);
+	if (ret) {
+		fprintf(stderr, "Failed to create evdev for '%s': %s\n", path, strerror(ret));
+		close(fd);
+		return NULL;
+	}
+
+	/* Timestamp events on the same clock as the frames are scheduled on. */
+	ret = libevdev_set_clock_id(evdev, CLOCK_MONOTONIC);
+	if (ret)
+		fprintf(stderr, "Unable to timestamp input of '%s' on the monotonic clock: %s\n",
+			path, strerror(-ret));
+
+	return evdev;
+}
+
+/**
+ * is_event_device - scandir helper to find an event device
+ *
+ * @dir:	pointer to a dirent structure
+ *
+ * Return:	1 if dir->d_name contains EVENT_DEV_NAME, 0 otherwise.
+ */
+static int is_event_device(const struct dirent *dir)
+{
+	return (strncmp(EVENT_DEV_NAME, dir->d_name, sizeof(EVENT_DEV_NAME) - 1) == 0);
+}
+
+/**
+ * evdev_sysfs_capable() - check the axes of an event device through sysfs
+ *
+ * @sysfs:	root of the sysfs tree
+ * @name:	name of the event device, event0 for example
+ *
+ * The absolute axis capabilities are a bitmask of hexadecimal words, most
+ * significant first, so ABS_X and ABS_Y are in the last word.
+ *
+ * Return:	false if sysfs shows that the device lacks the ABS_X or ABS_Y
+ *		axis, true otherwise, also when sysfs can not tell.
+ */
+static bool evdev_sysfs_capable(const char *sysfs, const char *name)
+{
+	const unsigned long axes = (1UL << ABS_X) | (1UL << ABS_Y);
+	char buf[SYSFS_ATTR_MAX];
+	char *word, *end;
+	unsigned long abs;
+
+	if (sysfs_read(sysfs, SYSFS_INPUT, name, "device/capabilities/abs", buf, sizeof(buf)))
+		return true;
+
+	word = strrchr(buf, ' ');
+	word = word ? word + 1 : buf;
+	abs = strtoul(word, &end, 16);
+	if ((end == word) || *end)
+		return true;
+
+	return (abs & axes) == axes;
+}
+
+/**
+ * evdev_grab() - grab an event device for exclusive access if requested
+ *
+ * @evdev:	pointer to a valid libevdev structure
+ * @path:	path of the event device
+ * @filter:	input devices to attach to
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int evdev_grab(struct libevdev *evdev, const char *path,
+		      const struct input_filter *filter)
+{
+	int ret;
+
+	if (!filter->grab)
+		return 0;
+
+	ret = libevdev_grab(evdev, LIBEVDEV_GRAB);
+	if (ret)
+		fprintf(stderr, "Skipping touch UI device '%s' (%s) in use: %s\n",
+			path, libevdev_get_name(evdev), strerror(-ret));
+
+	return ret;
+}
+
+/**
+ * evdev_probe() - open an event device if it is a capable touch device
+ *
+ * @filter:	input devices to attach to
+ * @name:	name of the event device in DEV_INPUT_EVENT, event0 for example
+ * @path:	returns the allocated path of the event device on success
+ *
+ * The device is only opened if sysfs does not show that it lacks the ABS_X
+ * and ABS_Y axis, as opening every device node is slow and may block on slow
+ * drivers, and is then checked to have the type EV_ABS, ABS_X and ABS_Y axis,
+ * the phys or uniq identifier of @filter if any, and the bus, vendor and
+ * product of the device attached to before if any.
+ *
+ * Return:	a valid pointer to a libevdev structure on success, NULL otherwise.
+ */
+static struct libevdev *evdev_probe(const struct input_filter *filter, const char *name,
+				    char **path)
+{
+	struct libevdev *evdev;
+
+	*path = NULL;
+	if (!evdev_sysfs_capable(filter->sysfs, name)) {
+		fprintf(stderr, "Skipping touch UI device '%s' without X and Y axes in sysfs.\n", name);
+		return NULL;
+	}
+
+	if (asprintf(path, DEV_INPUT_EVENT "/%s", name) < 0) {
+		fprintf(stderr, "Failed to create path for device '%s': %s\n", name, strerror(errno));
+		*path = NULL;
+		return NULL;
+	}
+
+	evdev = evdev_open(*path);
+	if (evdev &&
+	    !((libevdev_has_event_type(evdev, EV_ABS)) &&
+	      (libevdev_has_event_code(evdev, EV_ABS, ABS_X)) &&
+	      (libevdev_has_event_code(evdev, EV_ABS, ABS_Y)))) {
+		fprintf(stderr, "Skipping invalid touch UI device '%s' (%s).\n", *path, libevdev_get_name(evdev));
+		evdev_close(evdev);
+		evdev = NULL;
+	}
+
+	if (evdev && filter->match &&
+	    strcmp(filter->match, libevdev_get_phys(evdev) ? libevdev_get_phys(evdev) : "") &&
+	    strcmp(filter->match, libevdev_get_uniq(evdev) ? libevdev_get_uniq(evdev) : "")) {
+		fprintf(stderr, "Skipping touch UI device '%s' (%s) not matching '%s'.\n",
+			*path, libevdev_get_name(evdev), filter->match);
+		evdev_close(evdev);
+		evdev = NULL;
+	}
+
+	if (evdev && filter->identified &&
+	    ((libevdev_get_id_bustype(evdev) != filter->id.bustype) ||
+	     (libevdev_get_id_vendor(evdev) != filter->id.vendor) ||
+	     (libevdev_get_id_product(evdev) != filter->id.product))) {
+		fprintf(stderr, "Skipping touch UI device '%s' (%s), not the device that was lost.\n",
+			*path, libevdev_get_name(evdev));
+		evdev_close(evdev);
+		evdev = NULL;
+	}
+
+	if (evdev && evdev_grab(evdev, *path, filter)) {
+		evdev_close(evdev);
+		evdev = NULL;
+	}
+
+	if (!evdev) {
+		free(*path);
+		*path = NULL;
+	}
+
+	return evdev;
+}
+
+/**
+ * evdev_find() - find and open the first capable event device
+ *
+ * @filter:	input devices to attach to
+ * @path:	returns the allocated path of the event device on success
+ *
+ * Return:	a valid pointer to a libevdev structure on success, NULL otherwise.
+ */
+static struct libevdev *evdev_find(const struct input_filter *filter, char **path)
+{
+	struct libevdev *evdev = NULL;
+	struct dirent **namelist;
+	int ndev;
+	int i;
+
+	*path = NULL;
+	ndev = scandir(DEV_INPUT_EVENT, &namelist, is_event_device, versionsort);
+	if (ndev <= 0) {
+		fprintf(stderr, "Failed to find event device in " DEV_INPUT_EVENT ": %s\n", strerror(errno));
+		return NULL;
+	}
+
+	for (i = 0; i < ndev; i++) {
+		if (!evdev)
+			evdev = evdev_probe(filter, namelist[i]->d_name, path);
+		free(namelist[i]);
+	}
+	free(namelist);
+
+	return evdev;
+}
+
+/**
+ * evdev_get_device() - get an event device
+ *
+ * @path:	optional parameter to a unix file path (/dev/event/input0 for ex.)
+ * @filter:	input devices to attach to
+ *
+ * If path is not NULL, this function will try to open the supplied device,
+ * otherwise it will try to find and open a input event device in DEV_INPUT_EVENT
+ * that has the type EV_ABS, ABS_X and ABS_Y axis, see evdev_probe(). The bus,
+ * vendor and product of the device are kept in @filter, to attach only to the
+ * same device again should it be lost.
+ *
+ * Note that the caller is responsible for calling evdev_close() when done
+ * using the returned device pointer.
+ *
+ * Return:	a valid pointer to a libevdev structure on success, NULL otherwise.
+ */
+static struct libevdev *evdev_get_device(char *path, struct input_filter *filter)
+{
+	struct libevdev *evdev = NULL;
+
+	if (!path)
+		evdev = evdev_find(filter, &path);
+	else
+		evdev = evdev_open(path);
+	if ((!evdev) || (!path))
+		goto err_out;
+	if (evdev_grab(evdev, path, filter))
+		goto err_out;
+
+	printf("Found capable device at '%s'.\n", path);
+	printf("Input device name: '%s'\n", libevdev_get_name(evdev));
+	printf("Input device ID: bus %#x vendor %#x product %#x\n",
+	       libevdev_get_id_bustype(evdev),
+	       libevdev_get_id_vendor(evdev),
+	       libevdev_get_id_product(evdev));
+	printf("Evdev version: %x\n", libevdev_get_driver_version(evdev));
+	printf("Phys location: %s\n", libevdev_get_phys(evdev));
+	printf("Uniq identifier: %s\n", libevdev_get_uniq(evdev));
+
+	filter->id.bustype = libevdev_get_id_bustype(evdev);
+	filter->id.vendor = libevdev_get_id_vendor(evdev);
+	filter->id.product = libevdev_get_id_product(evdev);
+	filter->identified = true;
+
+	free(path);
+
+	return evdev;
+
+err_out:
+	if (evdev)
+		evdev_close(evdev);
+	if (path)
+		free(path);
+
+	return NULL;
+}
+
+static int evdev_input_get_fd(const struct input_dev *input)
+{
+	return libevdev_get_fd(input->priv);
+}
+
+static int evdev_input_next_event(struct input_dev *input, const unsigned int flags,
+				  struct input_event *event)
+{
+	return libevdev_next_event(input->priv, flags, event);
+}
+
+static int evdev_input_fetch_abs(const struct input_dev *input, const unsigned int code,
+				 int *value)
+{
+	return libevdev_fetch_event_value(input->priv, EV_ABS, code, value);
+}
+
+static const struct input_absinfo *evdev_input_abs_info(const struct input_dev *input,
+							const unsigned int code)
+{
+	return libevdev_get_abs_info(input->priv, code);
+}
+
+static bool evdev_input_touching(const struct input_dev *input)
+{
+	struct libevdev *evdev = input->priv;
+	int slot;
+
+	if (libevdev_get_event_value(evdev, EV_KEY, BTN_TOUCH))
+		return true;
+
+	for (slot = 0; slot < libevdev_get_num_slots(evdev); slot++)
+		if (libevdev_get_slot_value(evdev, slot, ABS_MT_TRACKING_ID) >= 0)
+			return true;
+
+	return false;
+}
+
+/**
+ * evdev_input_reconnect() - attach to an event device again after losing it
+ *
+ * @input:	pointer to an input_dev struct of which the device was lost
+ * @filter:	input devices to attach to
+ * @name:	name of the event device that appeared, or NULL to scan them all
+ *
+ * As the device may enumerate under a different name, any capable event
+ * device that passes @filter, and thus has the bus, vendor and product of the
+ * lost device, is attached to, see evdev_probe().
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int evdev_input_reconnect(struct input_dev *input, const struct input_filter *filter,
+				 const char *name)
+{
+	struct libevdev *evdev;
+	char *path;
+
+	if (name)
+		evdev = evdev_probe(filter, name, &path);
+	else
+		evdev = evdev_find(filter, &path);
+	if (!evdev)
+		return -ENODEV;
+
+	printf("Reconnected to '%s' (%s).\n", path, libevdev_get_name(evdev));
+	free(path);
+
+	evdev_close(input->priv);
+	input->priv = evdev;
+
+	return 0;
+}
+
+static void evdev_input_free(struct input_dev *input)
+{
+	evdev_close(input->priv);
+}
+
+static const struct input_ops evdev_input_ops = {
+	.get_fd = evdev_input_get_fd,
+	.next_event = evdev_input_next_event,
+	.fetch_abs = evdev_input_fetch_abs,
+	.abs_info = evdev_input_abs_info,
+	.touching = evdev_input_touching,
+	.reconnect = evdev_input_reconnect,
+	.free = evdev_input_free,
+};
+
+/**
+ * struct script_step - single step of an input script
+ *
+ * @time:	time of the step since the start of the script, in nanoseconds
+ * @x:		x coordinate of the touch
+ * @y:		y coordinate of the touch
+ * @drop:	simulate an overrun of the kernel event buffer instead of a touch
+ */
+struct script_step {
+	uint64_t time;
+	int32_t x;
+	int32_t y;
+	bool drop;
+};
+
+/**
+ * struct input_script - scripted input backend
+ *
+ * @timerfd:	timer expiring when the next step of the script is due
+ * @steps:	steps of the script
+ * @count:	number of steps in @steps
+ * @step:	index of the next step to generate events for
+ * @start:	time the script was started on CLOCK_MONOTONIC, in nanoseconds
+ * @x:		current x coordinate of the touch
+ * @y:		current y coordinate of the touch
+ * @events:	events generated for the current step
+ * @pending:	number of events in @events
+ * @event:	index of the next event in @events to return
+ */
+struct input_script {
+	int timerfd;
+	struct script_step *steps;
+	size_t count;
+	size_t step;
+	uint64_t start;
+	int32_t x;
+	int32_t y;
+	struct input_event events[3];
+	size_t pending;
+	size_t event;
+};
+
+/**
+ * script_arm() - arm the script timer
+ *
+ * @script:	pointer to a valid input_script struct
+ * @due:	time on CLOCK_MONOTONIC to expire at, in nanoseconds
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int script_arm(struct input_script *script, const uint64_t due)
+{
+	struct itimerspec timer = { 0 };
+
+	timer.it_value.tv_sec = due / NSEC_PER_SEC;
+	timer.it_value.tv_nsec = due % NSEC_PER_SEC;
+	if (timerfd_settime(script->timerfd, TFD_TIMER_ABSTIME, &timer, NULL) < 0)
+		return -errno;
+
+	return 0;
+}
+
+static int script_input_get_fd(const struct input_dev *input)
+{
+	const struct input_script *script = input->priv;
+
+	return script->timerfd;
+}
+
+/**
+ * script_input_next_event() - get the next event of an input script
+ *
+ * @input:	pointer to a valid input_dev struct of a script backend
+ * @flags:	LIBEVDEV_READ_FLAG_NORMAL or LIBEVDEV_READ_FLAG_SYNC
+ * @event:	returns the next event
+ *
+ * Every touch step of the script generates an ABS_X, ABS_Y and SYN_REPORT
+ * event, timestamped at the time the step is scheduled at. A drop step
+ * generates a SYN_DROPPED, after which the device state is already in sync.
+ * When no step is due, the timer is armed to expire at the next step.
+ *
+ * Return:	a libevdev_read_status on success, -EAGAIN if no events are
+ *		pending, -ENODATA if the script has finished.
+ */
+static int script_input_next_event(struct input_dev *input, const unsigned int flags,
+				   struct input_event *event)
+{
+	struct input_script *script = input->priv;
+	const struct script_step *step;
+	uint64_t expirations;
+	uint64_t due;
+	size_t i;
+	int ret;
+
+	if (flags & LIBEVDEV_READ_FLAG_SYNC)
+		return -EAGAIN;
+
+	if (script->event < script->pending) {
+		*event = script->events[script->event++];
+		return LIBEVDEV_READ_STATUS_SUCCESS;
+	}
+
+	if (script->step >= script->count)
+		return -ENODATA;
+
+	step = &script->steps[script->step];
+	due = script->start + step->time;
+	if (now_ns() < due) {
+		if ((read(script->timerfd, &expirations, sizeof(expirations)) < 0) &&
+		    (errno != EAGAIN))
+			return -errno;
+		ret = script_arm(script, due);
+
+		return ret ? ret : -EAGAIN;
+	}
+	script->step++;
+
+	memset(script->events, 0, sizeof(script->events));
+	for (i = 0; i < ARRAY_SIZE(script->events); i++) {
+		script->events[i].input_event_sec = due / NSEC_PER_SEC;
+		script->events[i].input_event_usec = (due % NSEC_PER_SEC) / NSEC_PER_USEC;
+	}
+
+	if (step->drop) {
+		script->events[0].type = EV_SYN;
+		script->events[0].code = SYN_DROPPED;
+		*event = script->events[0];
+		script->pending = 0;
+		script->event = 0;
+
+		return LIBEVDEV_READ_STATUS_SYNC;
+	}
+
+	script->x = step->x;
+	script->y = step->y;
+	script->events[0].type = EV_ABS;
+	script->events[0].code = ABS_X;
+	script->events[0].value = step->x;
+	script->events[1].type = EV_ABS;
+	script->events[1].code = ABS_Y;
+	script->events[1].value = step->y;
+	script->events[2].type = EV_SYN;
+	script->events[2].code = SYN_REPORT;
+	script->pending = ARRAY_SIZE(script->events);
+	script->event = 1;
+	*event = script->events[0];
+
+	return LIBEVDEV_READ_STATUS_SUCCESS;
+}
+
+static int script_input_fetch_abs(const struct input_dev *input, const unsigned int code,
+				  int *value)
+{
+	const struct input_script *script = input->priv;
+
+	if (code == ABS_X)
+		*value = script->x;
+	else if (code == ABS_Y)
+		*value = script->y;
+	else
+		return 0;
+
+	return 1;
+}
+
+static const struct input_absinfo *script_input_abs_info(const struct input_dev *input,
+							 const unsigned int code)
+{
+	return NULL;
+}
+
+static bool script_input_touching(const struct input_dev *input)
+{
+	return false;
+}
+
+static void script_input_free(struct input_dev *input)
+{
+	struct input_script *script = input->priv;
+
+	if (script->timerfd >= 0)
+		close(script->timerfd);
+	free(script->steps);
+	free(script);
+}
+
+static const struct input_ops script_input_ops = {
+	.get_fd = script_input_get_fd,
+	.next_event = script_input_next_event,
+	.fetch_abs = script_input_fetch_abs,
+	.abs_info = script_input_abs_info,
+	.touching = script_input_touching,
+	.free = script_input_free,
+};
+
+/**
+ * script_open() - load an input script
+ *
+ * @path:	required parameter to an input script file
+ *
+ * An input script is a text file with one step per line. A step is either
+ * '<ms> <x> <y>' to touch at <x>,<y>, or '<ms> drop' to simulate an overrun
+ * of the kernel event buffer, <ms> milliseconds after the start of the
+ * script. Steps must be in chronological order. Empty lines and lines
+ * starting with '#' are ignored. The script starts when it is loaded.
+ *
+ * Return:	a valid pointer to a input_script structure on success, NULL
+ *		otherwise.
+ */
+static struct input_script *script_open(const char *path)
+{
+	struct input_script *script = NULL;
+	size_t size = 0, lineno = 0;
+	char *line = NULL;
+	FILE *file;
+
+	file = fopen(path, "r");
+	if (!file) {
+		fprintf(stderr, "Unable to open '%s': %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	script = calloc(1, sizeof(*script));
+	if (!script) {
+		fprintf(stderr, "Failed to allocate memory: %s\n", strerror(errno));
+		goto err_close;
+	}
+	script->timerfd = -1;
+
+	while (getline(&line, &size, file) >= 0) {
+		struct script_step step = { 0 };
+		uint64_t msec;
+		size_t pos = strspn(line, " \t\r\n");
+		char word[5];
+
+		lineno++;
+		if ((line[pos] == '#') || (line[pos] == '\0'))
+			continue;
+
+		if (sscanf(line, "%" SCNu64 " %" SCNd32 " %" SCNd32, &msec, &step.x, &step.y) != 3) {
+			if ((sscanf(line, "%" SCNu64 " %4s", &msec, word) != 2) || strcmp(word, "drop")) {
+				fprintf(stderr, "Invalid step in '%s' on line %zu\n", path, lineno);
+				goto err_free;
+			}
+			step.drop = true;
+		}
+		step.time = msec * NSEC_PER_MSEC;
+		if (script->count && (step.time < script->steps[script->count - 1].time)) {
+			fprintf(stderr, "Step out of order in '%s' on line %zu\n", path, lineno);
+			goto err_free;
+		}
+
+		if (!(script->count % 64)) {
+			struct script_step *steps;
+
+			steps = realloc(script->steps, (script->count + 64) * sizeof(*steps));
+			if (!steps) {
+				fprintf(stderr, "Failed to allocate memory: %s\n", strerror(errno));
+				goto err_free;
+			}
+			script->steps = steps;
+		}
+		script->steps[script->count++] = step;
+	}
+
+	script->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (script->timerfd < 0) {
+		fprintf(stderr, "Unable to create script timer: %s\n", strerror(errno));
+		goto err_free;
+	}
+	script->start = now_ns();
+	if (script_arm(script, script->start)) {
+		fprintf(stderr, "Unable to start script timer: %s\n", strerror(errno));
+		goto err_free;
+	}
+
+	free(line);
+	fclose(file);
+
+	return script;
+
+err_free:
+	if (script->timerfd >= 0)
+		close(script->timerfd);
+	free(script->steps);
+	free(script);
+err_close:
+	free(line);
+	fclose(file);
+
+	return NULL;
+}
+
+/**
+ * DOC: input log format
+ *
+ * An input log starts with the 8 byte magic INPUT_LOG_MAGIC, followed by one
+ * record per input event:
+ *
+ *  - the time since the previous event, or since the start of the recording
+ *    for the first event, in microseconds, as an unsigned LEB128 varint
+ *  - the event type as a single byte, with INPUT_LOG_SYNC set for events
+ *    read while syncing the device state after a SYN_DROPPED
+ *  - the event code as an unsigned LEB128 varint
+ *  - the event value as a zigzag encoded signed LEB128 varint, relative to
+ *    the previous value of the same absolute axis for EV_ABS events
+ *
+ * Most events of a touch report share the timestamp of the report and move
+ * the axes by a small amount, so a typical event takes 4 to 5 bytes instead
+ * of the 24 bytes of a struct input_event.
+ */
+#define INPUT_LOG_MAGIC		"UCITLOG\x01"
+#define INPUT_LOG_SYNC		0x80
+
+/**
+ * struct input_log_codec - delta coding state of an input log
+ *
+ * @time:	time of the previous event, in microseconds
+ * @abs:	previous value of every absolute axis
+ */
+struct input_log_codec {
+	uint64_t time;
+	int32_t abs[ABS_CNT];
+};
+
+/**
+ * input_log_delta() - get the delta base of an event value
+ *
+ * @codec:	pointer to a valid input_log_codec struct
+ * @type:	type of the event
+ * @code:	code of the event
+ *
+ * Return:	pointer to the previous value of the axis, NULL if the value of
+ *		the event is not delta coded.
+ */
+static int32_t *input_log_delta(struct input_log_codec *codec, const unsigned int type,
+				const unsigned int code)
+{
+	if ((type == EV_ABS) && (code < ABS_CNT))
+		return &codec->abs[code];
+
+	return NULL;
+}
+
+/**
+ * input_log_put() - write an unsigned LEB128 varint
+ *
+ * @file:	file to write to
+ * @val:	value to write
+ */
+static void input_log_put(FILE *file, uint64_t val)
+{
+	while (val >= 0x80) {
+		putc((val & 0x7f) | 0x80, file);
+		val >>= 7;
+	}
+	putc(val, file);
+}
+
+/**
+ * input_log_get() - read an unsigned LEB128 varint
+ *
+ * @file:	file to read from
+ * @val:	returns the value read
+ *
+ * Return:	0 on success, -ENODATA at the end of the file, -EINVAL if the
+ *		varint is truncated or too long.
+ */
+static int input_log_get(FILE *file, uint64_t *val)
+{
+	unsigned int shift;
+	int c;
+
+	*val = 0;
+	for (shift = 0; shift < 64; shift += 7) {
+		c = getc(file);
+		if (c == EOF)
+			return shift ? -EINVAL : -ENODATA;
+		*val |= (uint64_t)(c & 0x7f) << shift;
+		if (!(c & 0x80))
+			return 0;
+	}
+
+	return -EINVAL;
+}
+
+/**
+ * struct input_replay - backend replaying an input log
+ *
+ * @file:	input log being replayed
+ * @timerfd:	timer expiring when the next event is due
+ * @speed:	factor to speed up the replay with, 0 to replay without delays
+ * @start:	time the replay was started on CLOCK_MONOTONIC, in nanoseconds
+ * @codec:	delta coding state of @file, timed since the start of the recording
+ * @event:	next event of the log
+ * @sync:	@event was read while syncing the device state
+ * @loaded:	@event holds the next event
+ * @x:		current x coordinate of the touch
+ * @y:		current y coordinate of the touch
+ */
+struct input_replay {
+	FILE *file;
+	int timerfd;
+	double speed;
+	uint64_t start;
+	struct input_log_codec codec;
+	struct input_event event;
+	bool sync;
+	bool loaded;
+	int32_t x;
+	int32_t y;
+};
+
+/**
+ * replay_load() - decode the next event of an input log
+ *
+ * @replay:	pointer to a valid input_replay struct
+ *
+ * Return:	0 on success, -ENODATA at the end of the log, -EINVAL if the
+ *		log is corrupt.
+ */
+static int replay_load(struct input_replay *replay)
+{
+	uint64_t delta, code, value;
+	int32_t *prev;
+	int type;
+	int ret;
+
+	ret = input_log_get(replay->file, &delta);
+	if (ret)
+		return ret;
+	type = getc(replay->file);
+	if ((type == EOF) || input_log_get(replay->file, &code) ||
+	    input_log_get(replay->file, &value) || (code > UINT16_MAX) || (value > UINT32_MAX))
+		return -EINVAL;
+
+	replay->codec.time += delta;
+	memset(&replay->event, 0, sizeof(replay->event));
+	replay->sync = type & INPUT_LOG_SYNC;
+	replay->event.type = type & ~INPUT_LOG_SYNC;
+	replay->event.code = code;
+	replay->event.value = (int32_t)((value >> 1) ^ -(value & 1));
+	prev = input_log_delta(&replay->codec, replay->event.type, replay->event.code);
+	if (prev) {
+		replay->event.value = (uint32_t)replay->event.value + (uint32_t)*prev;
+		*prev = replay->event.value;
+	}
+	replay->loaded = true;
+
+	return 0;
+}
+
+/**
+ * replay_arm() - arm the replay timer
+ *
+ * @replay:	pointer to a valid input_replay struct
+ * @due:	time on CLOCK_MONOTONIC to expire at, in nanoseconds
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int replay_arm(struct input_replay *replay, const uint64_t due)
+{
+	struct itimerspec timer = { 0 };
+
+	timer.it_value.tv_sec = due / NSEC_PER_SEC;
+	timer.it_value.tv_nsec = due % NSEC_PER_SEC;
+	if (timerfd_settime(replay->timerfd, TFD_TIMER_ABSTIME, &timer, NULL) < 0)
+		return -errno;
+
+	return 0;
+}
+
+static int replay_input_get_fd(const struct input_dev *input)
+{
+	const struct input_replay *replay = input->priv;
+
+	return replay->timerfd;
+}
+
+/**
+ * replay_input_next_event() - get the next event of an input log
+ *
+ * @input:	pointer to a valid input_dev struct of a replay backend
+ * @flags:	LIBEVDEV_READ_FLAG_NORMAL or LIBEVDEV_READ_FLAG_SYNC
+ * @event:	returns the next event
+ *
+ * Events are returned once their time since the start of the recording,
+ * divided by the replay speed, has passed since the start of the replay, and
+ * are timestamped at that time. Without a replay speed, events are returned
+ * as fast as they are read and timestamped at the time they are read. The
+ * events recorded while syncing after a SYN_DROPPED are only returned by
+ * LIBEVDEV_READ_FLAG_SYNC reads, as with libevdev.
+ *
+ * Return:	a libevdev_read_status on success, -EAGAIN if no events are
+ *		pending, -ENODATA if the log has finished, -EINVAL if the log is
+ *		corrupt.
+ */
+static int replay_input_next_event(struct input_dev *input, const unsigned int flags,
+				   struct input_event *event)
+{
+	struct input_replay *replay = input->priv;
+	uint64_t expirations;
+	uint64_t due;
+	int ret;
+
+	if (!replay->loaded) {
+		ret = replay_load(replay);
+		if (ret == -EINVAL)
+			fprintf(stderr, "Corrupt input log.\n");
+		if (ret)
+			return ret;
+	}
+
+	if ((flags & LIBEVDEV_READ_FLAG_SYNC) && !replay->sync)
+		return -EAGAIN;
+
+	if (replay->speed > 0.0)
+		due = replay->start + (replay->codec.time * NSEC_PER_USEC) / replay->speed;
+	else
+		due = now_ns();
+
+	if (!(flags & LIBEVDEV_READ_FLAG_SYNC) && (now_ns() < due)) {
+		if ((read(replay->timerfd, &expirations, sizeof(expirations)) < 0) &&
+		    (errno != EAGAIN))
+			return -errno;
+		ret = replay_arm(replay, due);
+
+		return ret ? ret : -EAGAIN;
+	}
+
+	*event = replay->event;
+	event->input_event_sec = due / NSEC_PER_SEC;
+	event->input_event_usec = (due % NSEC_PER_SEC) / NSEC_PER_USEC;
+	replay->loaded = false;
+
+	if (libevdev_event_is_code(event, EV_ABS, ABS_X))
+		replay->x = event->value;
+	else if (libevdev_event_is_code(event, EV_ABS, ABS_Y))
+		replay->y = event->value;
+
+	if (replay->sync || libevdev_event_is_code(event, EV_SYN, SYN_DROPPED))
+		return LIBEVDEV_READ_STATUS_SYNC;
+
+	return LIBEVDEV_READ_STATUS_SUCCESS;
+}
+
+static int replay_input_fetch_abs(const struct input_dev *input, const unsigned int code,
+				  int *value)
+{
+	const struct input_replay *replay = input->priv;
+
+	if (code == ABS_X)
+		*value = replay->x;
+	else if (code == ABS_Y)
+		*value = replay->y;
+	else
+		return 0;
+
+	return 1;
+}
+
+static const struct input_absinfo *replay_input_abs_info(const struct input_dev *input,
+							 const unsigned int code)
+{
+	return NULL;
+}
+
+static bool replay_input_touching(const struct input_dev *input)
+{
+	return false;
+}
+
+static bool replay_input_lossless(const struct input_dev *input)
+{
+	const struct input_replay *replay = input->priv;
+
+	/* Without delays, the whole log would be due at once. */
+	return replay->speed <= 0.0;
+}
+
+static void replay_input_free(struct input_dev *input)
+{
+	struct input_replay *replay = input->priv;
+
+	if (replay->timerfd >= 0)
+		close(replay->timerfd);
+	fclose(replay->file);
+	free(replay);
+}
+
+static const struct input_ops replay_input_ops = {
+	.get_fd = replay_input_get_fd,
+	.next_event = replay_input_next_event,
+	.fetch_abs = replay_input_fetch_abs,
+	.abs_info = replay_input_abs_info,
+	.touching = replay_input_touching,
+	.lossless = replay_input_lossless,
+	.free = replay_input_free,
+};
+
+/**
+ * replay_open() - start replaying an input log
+ *
+ * @path:	required parameter to an input log written by input_record()
+ * @speed:	factor to speed up the replay with, 0 to replay without delays
+ *
+ * The replay starts when the log is opened, so that the first event is
+ * replayed as long after the start as it was recorded after the start of the
+ * recording.
+ *
+ * Return:	a valid pointer to a input_replay structure on success, NULL
+ *		otherwise.
+ */
+static struct input_replay *replay_open(const char *path, const double speed)
+{
+	char magic[sizeof(INPUT_LOG_MAGIC) - 1];
+	struct input_replay *replay;
+
+	replay = calloc(1, sizeof(*replay));
+	if (!replay) {
+		fprintf(stderr, "Failed to allocate memory: %s\n", strerror(errno));
+		return NULL;
+	}
+	replay->timerfd = -1;
+	replay->speed = speed;
+
+	replay->file = fopen(path, "rb");
+	if (!replay->file) {
+		fprintf(stderr, "Unable to open '%s': %s\n", path, strerror(errno));
+		goto err_free;
+	}
+
+	if ((fread(magic, 1, sizeof(magic), replay->file) != sizeof(magic)) ||
+	    memcmp(magic, INPUT_LOG_MAGIC, sizeof(magic))) {
+		fprintf(stderr, "'%s' is not an input log\n", path);
+		goto err_close;
+	}
+
+	replay->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (replay->timerfd < 0) {
+		fprintf(stderr, "Unable to create replay timer: %s\n", strerror(errno));
+		goto err_close;
+	}
+	replay->start = now_ns();
+	if (replay_arm(replay, replay->start)) {
+		fprintf(stderr, "Unable to start replay timer: %s\n", strerror(errno));
+		goto err_timer;
+	}
+
+	return replay;
+
+err_timer:
+	close(replay->timerfd);
+err_close:
+	fclose(replay->file);
+err_free:
+	free(replay);
+
+	return NULL;
+}
+
+/**
+ * input_free() - free an input device
+ *
+ * @input:	a pointer to an input_dev structure
+ */
+static void input_free(struct input_dev *input)
+{
+	if (!input)
+		return;
+
+	input->ops->free(input);
+	free(input);
+}
+
+/**
+ * struct input_recorder - backend recording the events of another backend
+ *
+ * @input:	input device whose events are recorded
+ * @file:	input log being written
+ * @path:	path of @file, for error messages
+ * @codec:	delta coding state of @file
+ * @events:	number of events recorded
+ * @failed:	writing to @file failed, recording has stopped
+ */
+struct input_recorder {
+	struct input_dev *input;
+	FILE *file;
+	char *path;
+	struct input_log_codec codec;
+	uint64_t events;
+	bool failed;
+};
+
+static int record_input_get_fd(const struct input_dev *input)
+{
+	const struct input_recorder *recorder = input->priv;
+
+	return recorder->input->ops->get_fd(recorder->input);
+}
+
+/**
+ * record_input_next_event() - get and record the next event of the recorded device
+ *
+ * @input:	pointer to a valid input_dev struct of a recorder backend
+ * @flags:	LIBEVDEV_READ_FLAG_NORMAL or LIBEVDEV_READ_FLAG_SYNC
+ * @event:	returns the next event
+ *
+ * Return:	the return value of the recorded device.
+ */
+static int record_input_next_event(struct input_dev *input, const unsigned int flags,
+				   struct input_event *event)
+{
+	struct input_recorder *recorder = input->priv;
+	uint64_t time;
+	int32_t value;
+	int32_t *prev;
+	int ret;
+
+	ret = recorder->input->ops->next_event(recorder->input, flags, event);
+	if ((ret < 0) || recorder->failed)
+		return ret;
+
+	time = (event->input_event_sec * (NSEC_PER_SEC / NSEC_PER_USEC)) + event->input_event_usec;
+	input_log_put(recorder->file, (time > recorder->codec.time) ? time - recorder->codec.time : 0);
+	if (time > recorder->codec.time)
+		recorder->codec.time = time;
+
+	putc(event->type | ((flags & LIBEVDEV_READ_FLAG_SYNC) ? INPUT_LOG_SYNC : 0), recorder->file);
+	input_log_put(recorder->file, event->code);
+
+	value = event->value;
+	prev = input_log_delta(&recorder->codec, event->type, event->code);
+	if (prev) {
+		value = (uint32_t)event->value - (uint32_t)*prev;
+		*prev = event->value;
+	}
+	input_log_put(recorder->file, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+	recorder->events++;
+
+	if (ferror(recorder->file)) {
+		fprintf(stderr, "Failed to write input log '%s', recording stopped.\n", recorder->path);
+		recorder->failed = true;
+	}
+
+	return ret;
+}
+
+static int record_input_fetch_abs(const struct input_dev *input, const unsigned int code,
+				  int *value)
+{
+	const struct input_recorder *recorder = input->priv;
+
+	return recorder->input->ops->fetch_abs(recorder->input, code, value);
+}
+
+static const struct input_absinfo *record_input_abs_info(const struct input_dev *input,
+							 const unsigned int code)
+{
+	const struct input_recorder *recorder = input->priv;
+
+	return recorder->input->ops->abs_info(recorder->input, code);
+}
+
+static bool record_input_touching(const struct input_dev *input)
+{
+	const struct input_recorder *recorder = input->priv;
+
+	return recorder->input->ops->touching(recorder->input);
+}
+
+static bool record_input_lossless(const struct input_dev *input)
+{
+	const struct input_recorder *recorder = input->priv;
+
+	return recorder->input->ops->lossless && recorder->input->ops->lossless(recorder->input);
+}
+
+static int record_input_reconnect(struct input_dev *input, const struct input_filter *filter,
+				  const char *name)
+{
+	struct input_recorder *recorder = input->priv;
+
+	if (!recorder->input->ops->reconnect)
+		return -ENODEV;
+
+	return recorder->input->ops->reconnect(recorder->input, filter, name);
+}
+
+static void record_input_free(struct input_dev *input)
+{
+	struct input_recorder *recorder = input->priv;
+
+	if (fclose(recorder->file) && !recorder->failed)
+		fprintf(stderr, "Failed to write input log '%s': %s\n", recorder->path, strerror(errno));
+	else if (!recorder->failed)
+		printf("Recorded %" PRIu64 " input events to '%s'.\n", recorder->events, recorder->path);
+	input_free(recorder->input);
+	free(recorder->path);
+	free(recorder);
+}
+
+static const struct input_ops record_input_ops = {
+	.get_fd = record_input_get_fd,
+	.next_event = record_input_next_event,
+	.fetch_abs = record_input_fetch_abs,
+	.abs_info = record_input_abs_info,
+	.touching = record_input_touching,
+	.lossless = record_input_lossless,
+	.reconnect = record_input_reconnect,
+	.free = record_input_free,
+};
+
+/**
+ * input_record() - record the events of an input device
+ *
+ * @input:	pointer to a valid and initialized input_dev struct
+ * @path:	required parameter to the input log to write
  *
- * @dir:	pointer to a dirent structure
+ * All events read from the returned device are read from @input and written
+ * to the input log as they pass, so recording works with any backend. The
+ * recording starts when this function is called.
  *
- * Return:	1 if dir->d_name contains EVENT_DEV_NAME, 0 otherwise.
+ * Note that the returned device takes ownership of @input, also on failure.
+ *
+ * Return:	a valid pointer to an input_dev structure on success, NULL
+ *		otherwise.
  */
-static int is_event_device(const struct dirent *dir)
+static struct input_dev *input_record(struct input_dev *input, const char *path)
 {
-	return (strncmp(EVENT_DEV_NAME, dir->d_name, sizeof(EVENT_DEV_NAME) - 1) == 0);
+	struct input_recorder *recorder;
+	struct input_dev *record;
+
+	record = calloc(1, sizeof(*record));
+	recorder = calloc(1, sizeof(*recorder));
+	if (!record || !recorder) {
+		fprintf(stderr, "Failed to allocate memory: %s\n", strerror(errno));
+		goto err_free;
+	}
+
+	recorder->path = strdup(path);
+	recorder->file = fopen(path, "wb");
+	if (!recorder->path || !recorder->file) {
+		fprintf(stderr, "Unable to create '%s': %s\n", path, strerror(errno));
+		goto err_free;
+	}
+	fwrite(INPUT_LOG_MAGIC, 1, sizeof(INPUT_LOG_MAGIC) - 1, recorder->file);
+	recorder->codec.time = now_ns() / NSEC_PER_USEC;
+	recorder->input = input;
+
+	record->ops = &record_input_ops;
+	record->priv = recorder;
+	printf("Recording input to '%s'.\n", path);
+
+	return record;
+
+err_free:
+	if (recorder) {
+		if (recorder->file)
+			fclose(recorder->file);
+		free(recorder->path);
+	}
+	free(recorder);
+	free(record);
+	input_free(input);
+
+	return NULL;
 }
 
 /**
- * evdev_get_device() - get an event device
+ * input_get_device() - get an input device
  *
- * @path:	optional parameter to a unix file path (/dev/event/input0 for ex.)
+ * @evpath:	optional parameter to a unix file path of an input event device
+ * @filter:	input event devices to attach to, identifies the device attached to
+ * @opts:	pointer to valid options
  *
- * If path is not NULL, this function will try to open the supplied device,
- * otherwise it will try to find and open a input event device in DEV_INPUT_EVENT
- * that has the type EV_ABS, ABS_X and ABS_Y axis.
+ * If an input script is given, the input events are generated from the script
+ * using script_open(). If an input log is given, it is replayed using
+ * replay_open(). Otherwise an input event device is opened using
+ * evdev_get_device(). If an input log to record to is given, the events are
+ * recorded using input_record().
  *
- * Note that the caller is responsible for calling libedev_free() when done
+ * Note that the caller is responsible for calling input_free() when done
  * using the returned device pointer.
  *
- * Return:	a valid pointer to a libevdev structure on success, NULL otherwise.
+ * Return:	a valid pointer to an input_dev structure on success, NULL
+ *		otherwise.
  */
-static struct libevdev *evdev_get_device(char *path)
+static struct input_dev *input_get_device(char *evpath, struct input_filter *filter,
+					  const struct options *opts)
 {
-	struct libevdev *evdev = NULL;
-
-	if (!path) {
-		int i;
-		int ndev;
-		struct dirent **namelist;
-
-		ndev = scandir(DEV_INPUT_EVENT, &namelist, is_event_device, versionsort);
-		if (ndev <= 0) {
-			fprintf(stderr, "Failed to find event device in " DEV_INPUT_EVENT ": %s\n", strerror(errno));
-			return NULL;
-		}
-
-		for (i = 0; i < ndev; i++) {
-			int ret;
+	struct input_dev *input;
 
-			ret = asprintf(&path, DEV_INPUT_EVENT "/%s", namelist[i]->d_name);
-			free(namelist[i]);
-			if (ret < 0) {
-				fprintf(stderr, "Failed to create path for device %d: %s\n", i, strerror(errno));
-				continue;
-			}
+	input = calloc(1, sizeof(*input));
+	if (!input) {
+		fprintf(stderr, "Failed to allocate memory: %s\n", strerror(errno));
+		free(evpath);
+		return NULL;
+	}
 
-			evdev = evdev_open(path);
-			if (evdev) {
-				if ((libevdev_has_event_type(evdev, EV_ABS)) &&
-				    (libevdev_has_event_code(evdev, EV_ABS, ABS_X)) &&
-				    (libevdev_has_event_code(evdev, EV_ABS, ABS_Y))) {
-					break;
-				} else {
-					fprintf(stderr, "Skipping invalid touch UI device '%s' (%s).\n", path, libevdev_get_name(evdev));
-					libevdev_free(evdev);
-					evdev = NULL;
-				}
-			}
-		}
-		free(namelist);
+	if (opts->script) {
+		input->ops = &script_input_ops;
+		input->priv = script_open(opts->script);
+		free(evpath);
+		if (input->priv)
+			printf("Running input script '%s'.\n", opts->script);
+	} else if (opts->replay) {
+		input->ops = &replay_input_ops;
+		input->priv = replay_open(opts->replay, opts->speed);
+		free(evpath);
+		if (input->priv)
+			printf("Replaying input log '%s'.\n", opts->replay);
 	} else {
-		evdev = evdev_open(path);
+		input->ops = &evdev_input_ops;
+		input->priv = evdev_get_device(evpath, filter);
 	}
-	if ((!evdev) || (!path))
-		goto err_out;
-
-	printf("Found capable device at '%s'.\n", path);
-	printf("Input device name: '%s'\n", libevdev_get_name(evdev));
-	printf("Input device ID: bus %#x vendor %#x product %#x\n",
-	       libevdev_get_id_bustype(evdev),
-	       libevdev_get_id_vendor(evdev),
-	       libevdev_get_id_product(evdev));
-	printf("Evdev version: %x\n", libevdev_get_driver_version(evdev));
-	printf("Phys location: %s\n", libevdev_get_phys(evdev));
-	printf("Uniq identifier: %s\n", libevdev_get_uniq(evdev));
 
-	free(path);
-
-	return evdev;
+	if (!input->priv) {
+		free(input);
+		return NULL;
+	}
 
-err_out:
-	if (evdev)
-		libevdev_free(evdev);
-	if (path)
-		free(path);
+	if (opts->record)
+		input = input_record(input, opts->record);
 
-	return NULL;
+	return input;
 }
 
 /**
@@ -675,6 +6032,48 @@ static int is_fb_device(const struct dirent *dir)
 	return (strncmp(FB_DEV_NAME, dir->d_name, sizeof(FB_DEV_NAME) - 1) == 0);
 }
 
+/**
+ * disp_sysfs_capable() - check the geometry of a framebuffer through sysfs
+ *
+ * @sysfs:	root of the sysfs tree
+ * @name:	name of the framebuffer device, fb0 for example
+ *
+ * sysfs only describes the virtual size of the framebuffer, which is at least
+ * as large as the visible area, so the full check is left to disp_open().
+ *
+ * Return:	false if sysfs shows that the framebuffer is smaller than
+ *		DISPLAY_MIN_XRES by DISPLAY_MIN_YRES or that none of the pixel
+ *		formats has its depth, true otherwise, also when sysfs can not
+ *		tell.
+ */
+static bool disp_sysfs_capable(const char *sysfs, const char *name)
+{
+	char buf[SYSFS_ATTR_MAX];
+	uint32_t xres, yres, bits, stride;
+	size_t i;
+
+	if (sysfs_read(sysfs, SYSFS_GRAPHICS, name, "virtual_size", buf, sizeof(buf)) ||
+	    (sscanf(buf, "%u,%u", &xres, &yres) != 2))
+		return true;
+	if ((xres < DISPLAY_MIN_XRES) || (yres < DISPLAY_MIN_YRES))
+		return false;
+
+	if (sysfs_read(sysfs, SYSFS_GRAPHICS, name, "bits_per_pixel", buf, sizeof(buf)) ||
+	    (sscanf(buf, "%u", &bits) != 1))
+		return true;
+	for (i = 0; i < ARRAY_SIZE(pixel_formats); i++)
+		if (pixel_formats[i].bpp * CHAR_BIT == bits)
+			break;
+	if (i == ARRAY_SIZE(pixel_formats))
+		return false;
+
+	if (sysfs_read(sysfs, SYSFS_GRAPHICS, name, "stride", buf, sizeof(buf)) ||
+	    (sscanf(buf, "%u", &stride) != 1))
+		return true;
+
+	return stride >= (DISPLAY_MIN_XRES * bits / CHAR_BIT);
+}
+
 /**
  * disp_open() - open a framebuffer device node and initialize display_info
  *
@@ -693,6 +6092,7 @@ static struct display_info *disp_open(const char *path)
 {
 	struct fb_var_screeninfo var_info = { 0 };
 	struct fb_fix_screeninfo fix_info = { 0 };
+	const struct pixel_format *format;
 	struct display_info *disp = NULL;
 	int ret;
 
@@ -720,7 +6120,20 @@ static struct display_info *disp_open(const char *path)
 	}
 	disp->xres = var_info.xres;
 	disp->yres = var_info.yres;
-	disp->bpp = var_info.bits_per_pixel / CHAR_BIT;
+	disp->var_info = var_info;
+	disp->pages = 1;
+
+	format = pixel_format_find(&var_info);
+	if (!format) {
+		fprintf(stderr, "Unsupported pixel format of '%s': %u bpp, rgba %u/%u %u/%u %u/%u %u/%u.\n",
+			path, var_info.bits_per_pixel,
+			var_info.red.offset, var_info.red.length,
+			var_info.green.offset, var_info.green.length,
+			var_info.blue.offset, var_info.blue.length,
+			var_info.transp.offset, var_info.transp.length);
+		goto err_fb_dev;
+	}
+	disp_format_set(disp, format);
 
 	ret = ioctl(disp->fb_dev, FBIOGET_FSCREENINFO, &fix_info);
 	if (ret < 0) {
@@ -730,6 +6143,13 @@ static struct display_info *disp_open(const char *path)
 	disp->id = strlen(fix_info.id) ? strdup(fix_info.id) : strdup("(null)");
 	disp->fb_len = fix_info.smem_len;
 	disp->line_length = fix_info.line_length;
+	disp->ypanstep = fix_info.ypanstep;
+
+	if (disp_frame_init(disp)) {
+		fprintf(stderr, "Visible area of '%s' is outside of its framebuffer.\n", path);
+		free(disp->id);
+		goto err_fb_dev;
+	}
 
 	return disp;
 
@@ -745,11 +6165,13 @@ err_mem:
  * disp_get_device() - get a display device
  *
  * @path:	optional parameter to a unix file path (/dev/fb0 for ex.)
+ * @sysfs:	root of the sysfs tree to probe the framebuffer devices with
  *
  * If path is not NULL, this function will try to open the supplied device,
  * otherwise it will try to find and open a framebuffer device in DEV_FB that
- * is at least DISPLAY_MIN_XRES by DISPLAY_MIN_YRES with exactly DISPLAY_MIN_BPP
- * pixel byte depth.
+ * is at least DISPLAY_MIN_XRES by DISPLAY_MIN_YRES with a supported pixel
+ * format. Devices of which sysfs shows they do not qualify are skipped
+ * without opening them.
  *
  * Note that the caller is responsible for calling disp_free() when done using
  * the returned device pointer.
@@ -757,7 +6179,7 @@ err_mem:
  * Return:	a valid and mmapped display_info structure pointer on success,
  * 		NULL otherwise.
  */
-static struct display_info *disp_get_device(char *path)
+static struct display_info *disp_get_device(char *path, const char *sysfs)
 {
 	struct display_info *disp = NULL;
 
@@ -776,6 +6198,13 @@ static struct display_info *disp_get_device(char *path)
 		for (i = 0; i < ndev; i++) {
 			int ret;
 
+			if (!disp_sysfs_capable(sysfs, namelist[i]->d_name)) {
+				fprintf(stderr, "Skipping display device '%s' with unsupported geometry in sysfs.\n",
+					namelist[i]->d_name);
+				free(namelist[i]);
+				continue;
+			}
+
 			ret = asprintf(&path, DEV_FB "/%s", namelist[i]->d_name);
 			free(namelist[i]);
 			if (ret < 0) {
@@ -786,8 +6215,7 @@ static struct display_info *disp_get_device(char *path)
 			disp = disp_open(path);
 			if (disp) {
 				if ((disp->xres >= DISPLAY_MIN_XRES) &&
-				    (disp->yres >= DISPLAY_MIN_YRES) &&
-				    (disp->bpp == DISPLAY_MIN_BPP)) {
+				    (disp->yres >= DISPLAY_MIN_YRES)) {
 						break;
 				} else {
 					fprintf(stderr, "Skipping invalid display device '%s' (%s).\n", path, disp->id);
@@ -813,6 +6241,7 @@ static struct display_info *disp_get_device(char *path)
 	printf("Found capable device at '%s'.\n", path);
 	printf("Display device name: '%s'\n", disp->id);
 	printf("Display resolution: '%d x %d @%dbpp'.\n", disp->xres, disp->yres, disp->bpp * CHAR_BIT);
+	printf("Display pixel format: '%s'.\n", disp->format->name);
 
 	free(path);
 
@@ -827,17 +6256,190 @@ err_out:
 	return NULL;
 }
 
+/**
+ * disp_virtual_open() - create a virtual display in memory
+ *
+ * @path:	optional parameter to a file to back the display with
+ * @geometry:	memory layout of the display
+ *
+ * The virtual display behaves as a framebuffer without page flipping, backed
+ * by anonymous memory, or by @path if supplied so that the frames can be
+ * inspected. A @geometry without a line length uses packed lines.
+ *
+ * Note that the caller is responsible for calling disp_free() when done using
+ * the returned device pointer.
+ *
+ * Return:	a valid and mmapped display_info structure pointer on success,
+ *		NULL otherwise.
+ */
+static struct display_info *disp_virtual_open(const char *path,
+					      const struct disp_geometry *geometry)
+{
+	struct display_info *disp = NULL;
+	uint32_t line_length;
+
+	line_length = geometry->line_length ? geometry->line_length :
+		      geometry->xres * geometry->format->bpp;
+	if (!geometry->xres || !geometry->yres ||
+	    (line_length < (geometry->xres * geometry->format->bpp))) {
+		fprintf(stderr, "Invalid virtual display geometry.\n");
+		return NULL;
+	}
+
+	disp = calloc(1, sizeof(struct display_info));
+	if (!disp) {
+		fprintf(stderr, "Failed to allocate memory: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	if (path)
+		disp->fb_dev = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	else
+		disp->fb_dev = memfd_create("ucit-fb", MFD_CLOEXEC);
+	if (disp->fb_dev < 0) {
+		fprintf(stderr, "Failed to create virtual display: %s.\n", strerror(errno));
+		goto err_mem;
+	}
+
+	disp->id = strdup("virtual");
+	disp->xres = geometry->xres;
+	disp->yres = geometry->yres;
+	disp_format_set(disp, geometry->format);
+	disp->line_length = line_length;
+	disp->fb_len = (size_t)line_length * geometry->yres;
+	disp_frame_init(disp);
+	disp->pages = 1;
+	disp->var_info.xres = disp->xres;
+	disp->var_info.yres = disp->yres;
+	disp->var_info.xres_virtual = disp->xres;
+	disp->var_info.yres_virtual = disp->yres;
+	disp->var_info.bits_per_pixel = disp->bpp * CHAR_BIT;
+	disp->var_info.red = geometry->format->red;
+	disp->var_info.green = geometry->format->green;
+	disp->var_info.blue = geometry->format->blue;
+	disp->var_info.transp = geometry->format->transp;
+
+	if (ftruncate(disp->fb_dev, disp->fb_len) < 0) {
+		fprintf(stderr, "Failed to size virtual display: %s.\n", strerror(errno));
+		goto err_fb_dev;
+	}
+
+	disp->fb = (uint8_t *)mmap(NULL, disp->fb_len, PROT_READ | PROT_WRITE, MAP_SHARED, disp->fb_dev, 0);
+	if (disp->fb == MAP_FAILED) {
+		fprintf(stderr, "Failed to map virtual display: %s.\n", strerror(errno));
+		goto err_fb_dev;
+	}
+
+	printf("Virtual display backed by '%s'.\n", path ? path : "memory");
+	printf("Display resolution: '%d x %d @%dbpp'.\n", disp->xres, disp->yres, disp->bpp * CHAR_BIT);
+	printf("Display pixel format: '%s'.\n", disp->format->name);
+
+	return disp;
+
+err_fb_dev:
+	close(disp->fb_dev);
+	free(disp->id);
+err_mem:
+	free(disp);
+
+	return NULL;
+}
+
+/**
+ * parse_geometry() - parse the memory layout of a virtual display
+ *
+ * @arg:	layout as <X>x<Y>[x<bpp|format>][,<line_length>], bpp in bits
+ * @geometry:	returns the parsed layout
+ *
+ * A depth selects the first pixel format of that depth, XRGB8888 if omitted.
+ *
+ * Return:	0 on success or an error otherwise.
+ */
+static int parse_geometry(const char *arg, struct disp_geometry *geometry)
+{
+	struct fb_var_screeninfo var_info = { 0 };
+	int pos = 0;
+	size_t i;
+
+	memset(geometry, 0, sizeof(*geometry));
+	geometry->format = &pixel_formats[0];
+	if (sscanf(arg, "%ux%u%n", &geometry->xres, &geometry->yres, &pos) != 2)
+		return -EINVAL;
+	arg += pos;
+
+	pos = 0;
+	if ((*arg == 'x') && (sscanf(arg, "x%u%n", &var_info.bits_per_pixel, &pos) == 1)) {
+		geometry->format = pixel_format_find(&var_info);
+		if (!geometry->format)
+			return -EINVAL;
+	} else if (*arg == 'x') {
+		arg++;
+		pos = strcspn(arg, ",");
+		for (i = 0; i < ARRAY_SIZE(pixel_formats); i++)
+			if ((strlen(pixel_formats[i].name) == (size_t)pos) &&
+			    !strncasecmp(arg, pixel_formats[i].name, pos))
+				break;
+		if (i >= ARRAY_SIZE(pixel_formats))
+			return -EINVAL;
+		geometry->format = &pixel_formats[i];
+	}
+	arg += pos;
+
+	pos = 0;
+	if ((*arg == ',') && (sscanf(arg, ",%u%n", &geometry->line_length, &pos) != 1))
+		return -EINVAL;
+	arg += pos;
+
+	if (*arg != '\0')
+		return -EINVAL;
+
+	return 0;
+}
+
+/**
+ * parse_cpus() - parse a list of CPUs
+ *
+ * @arg:	comma separated list of CPUs and ranges of CPUs, as 0,2-3
+ * @cpus:	returns the parsed CPUs
+ *
+ * Return:	0 on success or an error otherwise.
+ */
+static int parse_cpus(const char *arg, cpu_set_t *cpus)
+{
+	CPU_ZERO(cpus);
+	for (;;) {
+		unsigned int first, last;
+		int pos = 0;
+
+		if (sscanf(arg, "%u%n", &first, &pos) != 1)
+			return -EINVAL;
+		arg += pos;
+
+		last = first;
+		pos = 0;
+		if ((*arg == '-') && (sscanf(arg, "-%u%n", &last, &pos) != 1))
+			return -EINVAL;
+		arg += pos;
+
+		if ((last < first) || (last >= CPU_SETSIZE))
+			return -EINVAL;
+		for (; first <= last; first++)
+			CPU_SET(first, cpus);
+
+		if (*arg == '\0')
+			return 0;
+		if (*arg != ',')
+			return -EINVAL;
+		arg++;
+	}
+}
+
 /**
  * parse_opts() - parses command line argument options
  *
  * @argc:	argument count, as passed from main()
  * @argv:	argument list, as passed from main()
- * @abort:	returns the abort on test success setting
- * @fbpath:	returns the frame buffer device supplied via -f or NULL
- * @evpath:	returns the input event device supplied via -e or NULL
- * @xsize:	returns the size along the X-axis for the test pattern
- * @ysize:	returns the size along the Y-axis for the test pattern
- * @fadespeed:	returns the speed of fade (decay) of the test pattern
+ * @opts:	returns the parsed options
  *
  * This function parses the command line arguments as supplied to the program,
  * tests some for validity and returns these values. Invalid parameters cause
@@ -846,57 +6448,146 @@ err_out:
  *
  * Return:	0 on success or an error otherwise.
  */
-static int parse_opts(int argc, char *argv[], bool *abort, char **fbpath, char **evpath, uint32_t *xsize, uint32_t *ysize, uint32_t *fadespeed, bool *banding)
+static int parse_opts(int argc, char *argv[], struct options *opts)
 {
 	int c;
 	int option_index = 0;
+	char *end;
 	static struct option long_options[] = {
 		{ "abort",	no_argument,		NULL, 'a' },
+		{ "analyse-input", no_argument,		NULL, 'A' },
 		{ "fb", 	required_argument,	NULL, 'f' },
 		{ "evdev",	required_argument,	NULL, 'e' },
 		{ "touchsize",	required_argument,	NULL, 't' },
 		{ "fadespeed",	required_argument,	NULL, 's' },
+		{ "framerate",	required_argument,	NULL, 'r' },
 		{ "banding",	no_argument,		NULL, 'b' },
+		{ "threads",	required_argument,	NULL, 'j' },
+		{ "lock-memory", no_argument,		NULL, 'L' },
+		{ "realtime",	optional_argument,	NULL, 'T' },
+		{ "cpus",	required_argument,	NULL, 'c' },
+		{ "virtual-fb",	required_argument,	NULL, 'V' },
+		{ "script",	required_argument,	NULL, 'S' },
+		{ "record",	required_argument,	NULL, 'w' },
+		{ "replay",	required_argument,	NULL, 'R' },
+		{ "replay-speed", required_argument,	NULL, 'X' },
+		{ "sysfs",	required_argument,	NULL, 'y' },
+		{ "coverage",	required_argument,	NULL, 'C' },
+		{ "station",	required_argument,	NULL, 'P' },
 		{ "version",	no_argument,		NULL, 'v' },
 		{ "help",	no_argument,		NULL, 'h' },
 		{ NULL,		0,			NULL, 0 }
 	};
 
-	*abort = false;
-	*banding = false;
-	*evpath = NULL;
-	*fadespeed = INPUT_DEFAULT_FADE;
-	*fbpath = NULL;
-	*xsize = INPUT_DEFAULT_XSIZE;
-	*ysize = INPUT_DEFAULT_YSIZE;
-	while ((c = getopt_long(argc, argv, "ae:f:t:s:bvh", long_options, &option_index)) != -1) {
+	memset(opts, 0, sizeof(*opts));
+	opts->fade = INPUT_DEFAULT_FADE;
+	opts->framerate = DISPLAY_DEFAULT_FRAME_RATE;
+	opts->threads = RENDER_DEFAULT_THREADS;
+	opts->speed = 1.0;
+	opts->xsize = INPUT_DEFAULT_XSIZE;
+	opts->ysize = INPUT_DEFAULT_YSIZE;
+	while ((c = getopt_long(argc, argv, "aAe:f:t:s:r:bj:LT::c:V:S:w:R:X:y:C:P:vh", long_options, &option_index)) != -1) {
 		switch(c) {
 		case 'a':
-			*abort = true;
+			opts->abort = true;
+			break;
+		case 'A':
+			opts->analyse = true;
 			break;
 		case 'e':
-			*evpath = strdup(optarg);
+			opts->evpath = strdup(optarg);
 			break;
 		case 'f':
-			*fbpath = strdup(optarg);
+			opts->fbpath = strdup(optarg);
 			break;
 		case 't':
-			if (sscanf(optarg, "%ux%u", xsize, ysize) != 2) {
-				*xsize = atoi(optarg);
-				*ysize = *xsize;
+			if (sscanf(optarg, "%ux%u", &opts->xsize, &opts->ysize) != 2) {
+				opts->xsize = atoi(optarg);
+				opts->ysize = opts->xsize;
 			}
-			if (*ysize == 0)
-				*ysize = INPUT_DEFAULT_YSIZE;
-			if (*xsize == 0)
-				*xsize = INPUT_DEFAULT_XSIZE;
+			if (opts->ysize == 0)
+				opts->ysize = INPUT_DEFAULT_YSIZE;
+			if (opts->xsize == 0)
+				opts->xsize = INPUT_DEFAULT_XSIZE;
 			break;
 		case 's':
-			*fadespeed = atoi(optarg);
-			if (*fadespeed > INPUT_MAX_FADE)
-				*fadespeed = INPUT_MAX_FADE;
+			opts->fade = atoi(optarg);
+			if (opts->fade > INPUT_MAX_FADE)
+				opts->fade = INPUT_MAX_FADE;
+			break;
+		case 'r':
+			opts->framerate = atoi(optarg);
+			if (opts->framerate == 0)
+				opts->framerate = DISPLAY_DEFAULT_FRAME_RATE;
+			if (opts->framerate > DISPLAY_MAX_FRAME_RATE)
+				opts->framerate = DISPLAY_MAX_FRAME_RATE;
 			break;
 		case 'b':
-			*banding = true;
+			opts->banding = true;
+			break;
+		case 'j':
+			opts->threads = atoi(optarg);
+			if (opts->threads == 0)
+				opts->threads = RENDER_DEFAULT_THREADS;
+			if (opts->threads > RENDER_MAX_THREADS)
+				opts->threads = RENDER_MAX_THREADS;
+			break;
+		case 'L':
+			opts->lock = true;
+			break;
+		case 'T':
+			opts->realtime = optarg ? atoi(optarg) : REALTIME_DEFAULT_PRIORITY;
+			if ((opts->realtime < (uint32_t)sched_get_priority_min(SCHED_FIFO)) ||
+			    (opts->realtime > (uint32_t)sched_get_priority_max(SCHED_FIFO))) {
+				fprintf(stderr, "Invalid real-time priority '%s'\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'c':
+			if (parse_cpus(optarg, &opts->cpus)) {
+				fprintf(stderr, "Invalid CPU list '%s'\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'V':
+			if (parse_geometry(optarg, &opts->virt)) {
+				fprintf(stderr, "Invalid virtual display geometry '%s'\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'S':
+			opts->script = strdup(optarg);
+			break;
+		case 'w':
+			opts->record = strdup(optarg);
+			break;
+		case 'R':
+			opts->replay = strdup(optarg);
+			break;
+		case 'X':
+			if (!strcmp(optarg, "max")) {
+				opts->speed = 0.0;
+				break;
+			}
+			opts->speed = strtod(optarg, &end);
+			if ((end == optarg) || *end || !isfinite(opts->speed) || (opts->speed <= 0.0)) {
+				fprintf(stderr, "Invalid replay speed '%s'\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'y':
+			free(opts->sysfs);
+			opts->sysfs = strdup(optarg);
+			break;
+		case 'C':
+			opts->coverage = strdup(optarg);
+			break;
+		case 'P':
+			if (opts->station_count == STATION_MAX) {
+				fprintf(stderr, "Too many stations, at most %u are supported\n", STATION_MAX);
+				exit(EXIT_FAILURE);
+			}
+			opts->stations[opts->station_count++] = strdup(optarg);
 			break;
 		case 'v':
 			version();
@@ -916,58 +6607,185 @@ static int parse_opts(int argc, char *argv[], bool *abort, char **fbpath, char *
 		}
 	}
 	if (optind < argc) {
-		*fbpath = strdup(argv[optind]);
+		opts->fbpath = strdup(argv[optind]);
 		optind++;
 	}
 	if (optind < argc) {
-		*evpath = strdup(argv[optind]);
+		opts->evpath = strdup(argv[optind]);
+	}
+	/* Without a display, the only device argument is the event device. */
+	if (opts->analyse && !opts->evpath) {
+		opts->evpath = opts->fbpath;
+		opts->fbpath = NULL;
+	}
+	if (!opts->sysfs)
+		opts->sysfs = strdup(SYSFS_ROOT);
+	if (opts->station_count && (opts->fbpath || opts->evpath)) {
+		fprintf(stderr, "Devices are given per station when testing stations\n");
+		exit(EXIT_FAILURE);
+	}
+	if ((opts->station_count > 1) && opts->record) {
+		fprintf(stderr, "Recording input is not supported with multiple stations\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return 0;
+}
+
+/**
+ * station_open() - open the display and input device of a station
+ *
+ * @station:	station to open, with its input filter set
+ * @fbpath:	optional framebuffer device, or file backing the virtual display
+ * @evpath:	optional input event device
+ * @opts:	command line options of the test
+ *
+ * Both @fbpath and @evpath are released by this function.
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int station_open(struct station *station, char *fbpath, char *evpath,
+			const struct options *opts)
+{
+	if (opts->virt.xres) {
+		station->disp = disp_virtual_open(fbpath, &opts->virt);
+		free(fbpath);
+	} else {
+		station->disp = disp_get_device(fbpath, opts->sysfs);
+	}
+	if (!station->disp) {
+		free(evpath);
+		return -ENODEV;
 	}
 
+	station->input = input_get_device(evpath, &station->filter, opts);
+	if (!station->input)
+		return -ENODEV;
+
 	return 0;
 }
 
+/**
+ * station_parse() - open a station from its description
+ *
+ * @station:	station to open, with its input filter set
+ * @spec:	description of the station, as <fb_dev>[,<ev_dev|phys|uniq>]
+ * @opts:	command line options of the test
+ *
+ * The touch screen of the station is the event device if an absolute path is
+ * given, otherwise the first free capable event device with the given phys
+ * location or uniq identifier, or any if none is given. Note that @spec is
+ * referred to until the station is closed.
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int station_parse(struct station *station, const char *spec, const struct options *opts)
+{
+	const char *touch = strchr(spec, ',');
+	char *fbpath = NULL, *evpath = NULL;
+
+	if (spec[0] && (spec[0] != ','))
+		fbpath = strndup(spec, touch ? (size_t)(touch - spec) : strlen(spec));
+	if (touch && (touch[1] == '/'))
+		evpath = strdup(touch + 1);
+	else if (touch && touch[1])
+		station->filter.match = touch + 1;
+
+	return station_open(station, fbpath, evpath, opts);
+}
+
+/**
+ * station_close() - close the display and input device of a station
+ *
+ * @station:	station to close
+ */
+static void station_close(struct station *station)
+{
+	if (station->input)
+		input_free(station->input);
+	if (station->disp)
+		disp_free(station->disp);
+}
+
+/* The benchmarks include this file and provide their own main(). */
+#ifndef UCIT_NO_MAIN
 int main(int argc, char *argv[])
 {
-	bool abort = false;
-	bool banding = false;
-	char *evpath = NULL;
-	char *fbpath = NULL;
 	int ret = EXIT_SUCCESS;
-	struct display_info *disp = NULL;
-	struct libevdev *evdev = NULL;
-	struct sigaction act = { 0 };
-	uint32_t fade = INPUT_DEFAULT_FADE;
-	uint32_t xsize = INPUT_DEFAULT_XSIZE;
-	uint32_t ysize = INPUT_DEFAULT_YSIZE;
+	struct station *stations = NULL;
+	struct options opts;
+	uint64_t start = now_ns();
+	size_t count;
+	size_t i;
 
-	act.sa_handler = sigint_handler;
-	sigaction(SIGINT, &act, NULL);
-
-	ret = parse_opts(argc, argv, &abort, &fbpath, &evpath, &xsize, &ysize, &fade, &banding);
+	ret = parse_opts(argc, argv, &opts);
 	if (ret)
 		return EXIT_FAILURE;
+	opts.start = start;
 
-	disp = disp_get_device(fbpath);
-	if (!disp)
-		return EXIT_FAILURE;
+	if (realtime_init(&opts)) {
+		ret = EXIT_FAILURE;
+		goto err_opts;
+	}
 
-	evdev = evdev_get_device(evpath);
-	if (!evdev) {
+	if (opts.analyse) {
+		struct input_filter filter = { .sysfs = opts.sysfs };
+		struct input_dev *input;
+
+		free(opts.fbpath);
+		input = input_get_device(opts.evpath, &filter, &opts);
+		if (!input || input_analyse(input))
+			ret = EXIT_FAILURE;
+		if (input)
+			input_free(input);
+		goto err_opts;
+	}
+
+	render_kernel_select();
+
+	count = opts.station_count ? opts.station_count : 1;
+	stations = calloc(count, sizeof(*stations));
+	if (!stations) {
+		fprintf(stderr, "Failed to allocate memory: %s\n", strerror(errno));
 		ret = EXIT_FAILURE;
-		goto err_disp;
+		goto err_opts;
 	}
 
-	renderloop(evdev, disp, xsize, ysize, fade, banding, abort);
+	for (i = 0; i < count; i++) {
+		int err;
 
-	libevdev_free(evdev);
+		/* Grabbing keeps stations from sharing the same touch screen. */
+		stations[i].filter.sysfs = opts.sysfs;
+		stations[i].filter.grab = (count > 1);
+		if (opts.station_count) {
+			err = station_parse(&stations[i], opts.stations[i], &opts);
+		} else {
+			err = station_open(&stations[i], opts.fbpath, opts.evpath, &opts);
+			opts.fbpath = NULL;
+			opts.evpath = NULL;
+		}
+		if (err) {
+			ret = EXIT_FAILURE;
+			goto err_stations;
+		}
+	}
 
-err_disp:
-	disp_free(disp);
+	if (renderloop(stations, count, &opts))
+		ret = EXIT_FAILURE;
 
-	if (fbpath)
-		free(fbpath);
-	if (evpath)
-		free(evpath);
+err_stations:
+	for (i = 0; i < count; i++)
+		station_close(&stations[i]);
+	free(stations);
+err_opts:
+	for (i = 0; i < opts.station_count; i++)
+		free(opts.stations[i]);
+	free(opts.sysfs);
+	free(opts.coverage);
+	free(opts.script);
+	free(opts.record);
+	free(opts.replay);
 
 	return ret;
 }
+#endif
@@ -0,0 +1,732 @@
+/*
+ * (C) Copyright 2018
+ * Olliver Schinagl <o.schinagl@ultimaker.com>
+ *
+ * SPX-License-Identifier:	AGPL-3.0+
+ *
+ */
+
+/*
+ * Microbenchmarks of the render and input kernels of ucit. The tester itself
+ * is included, so that its static functions are benchmarked as they are
+ * built into the application.
+ */
+#include "ucit.c"
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+
+#define BENCH_DEFAULT_TOLERANCE	10
+#define BENCH_BATCHES		11
+#define BENCH_BATCH_NS		(10 * NSEC_PER_MSEC)
+#define BENCH_NOISE_NS		1000
+#define BENCH_SPREAD_FACTOR	3
+#define BENCH_RETRIES		3
+#define BENCH_THREADS_MAX	7
+#define BENCH_REPLAY_SAMPLES	(4 * INPUT_RING_SIZE)
+#define BENCH_REPLAY_TIMEOUT_NS	(10 * NSEC_PER_SEC)
+
+/**
+ * struct bench_geometry - synthetic display to benchmark against
+ *
+ * @xres:	resolution along the X-axis
+ * @yres:	resolution along the Y-axis
+ * @format:	index of the pixel format in pixel_formats[]
+ */
+static const struct bench_geometry {
+	uint32_t xres;
+	uint32_t yres;
+	size_t format;
+} bench_geometries[] = {
+	{ .xres = 800, .yres = 320, .format = 0 },
+	{ .xres = 1024, .yres = 600, .format = 0 },
+	{ .xres = 1280, .yres = 800, .format = 0 },
+	{ .xres = 1920, .yres = 1080, .format = 0 },
+	{ .xres = 1024, .yres = 600, .format = 2 },
+	{ .xres = 1024, .yres = 600, .format = 3 },
+};
+
+/**
+ * struct bench_ctx - state a benchmark runs on
+ *
+ * @disp:		synthetic display, its framebuffer in ordinary memory
+ * @damage:		dirty tile tracking of @disp
+ * @bands:		banded lines of @disp
+ * @coverage:		touch coverage of the test pattern grid of @disp
+ * @arena:		arena the framebuffer and all other buffers are carved from
+ */
+struct bench_ctx {
+	struct display_info disp;
+	struct damage_info damage;
+	uint8_t *bands;
+	struct coverage coverage;
+	struct arena arena;
+};
+
+/**
+ * bench_setup() - reset the state of a benchmark
+ *
+ * @ctx:	pointer to a valid and initialized bench_ctx struct
+ *
+ * Every other tile is given a different input mask intensity, so that rows
+ * are composed of many short spans as during a busy touch test.
+ */
+static void bench_setup(struct bench_ctx *ctx)
+{
+	size_t tiles = ctx->damage.cols * ctx->damage.rows;
+	size_t i;
+
+	for (i = 0; i < tiles; i++)
+		ctx->damage.level[i] = (i % 2) ? (i * 37) : 0;
+}
+
+static size_t bench_draw(struct bench_ctx *ctx)
+{
+	struct render_pipeline pipe;
+	struct region region;
+
+	render_pipeline_select(&pipe, &ctx->disp, NULL, 1, INPUT_DEFAULT_FADE);
+	frame_region(&ctx->disp, &region);
+	background_draw(ctx->disp.fb, &ctx->damage, &ctx->disp, &pipe, &region);
+
+	return ctx->disp.fb_len;
+}
+
+static size_t bench_draw_banding(struct bench_ctx *ctx)
+{
+	struct render_pipeline pipe;
+	struct region region;
+
+	render_pipeline_select(&pipe, &ctx->disp, ctx->bands, 1, INPUT_DEFAULT_FADE);
+	frame_region(&ctx->disp, &region);
+	background_draw(ctx->disp.fb, &ctx->damage, &ctx->disp, &pipe, &region);
+
+	return ctx->disp.fb_len;
+}
+
+static size_t bench_fade(struct bench_ctx *ctx)
+{
+	input_fade(&ctx->damage, 1);
+
+	return ctx->damage.cols * ctx->damage.rows;
+}
+
+static size_t bench_mark(struct bench_ctx *ctx)
+{
+	uint32_t x, y;
+
+	for (y = 0; y < ctx->disp.yres; y += ctx->damage.tile_h)
+		for (x = 0; x < ctx->disp.xres; x += ctx->damage.tile_w)
+			input_mark(&ctx->coverage, &ctx->damage, &ctx->disp, x, y, 0,
+				   ctx->damage.tile_w, ctx->damage.tile_h);
+	ctx->damage.count = 0;
+	memset(ctx->damage.queued, false, ctx->damage.cols * ctx->damage.rows);
+
+	return ctx->damage.cols * ctx->damage.rows;
+}
+
+/**
+ * struct bench_case - single benchmark
+ *
+ * @name:	name of the benchmark
+ * @kernels:	run the benchmark once for every available render kernel
+ * @run:	run a single frame worth of the benchmark, returns bytes written
+ */
+static const struct bench_case {
+	const char *name;
+	bool kernels;
+	size_t (*run)(struct bench_ctx *ctx);
+} bench_cases[] = {
+	{ .name = "background_draw", .kernels = true, .run = bench_draw },
+	{ .name = "background_draw_banding", .kernels = true, .run = bench_draw_banding },
+	{ .name = "input_fade", .kernels = true, .run = bench_fade },
+	{ .name = "input_mark", .kernels = false, .run = bench_mark },
+};
+
+/**
+ * cycles_open() - open a counter of the CPU cycles spent by this thread
+ *
+ * Return:	a file descriptor of the counter, or a negative value if the
+ *		cycles can not be counted.
+ */
+static int cycles_open(void)
+{
+	struct perf_event_attr attr = { 0 };
+
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+/**
+ * cycles_read() - read the CPU cycle counter
+ *
+ * @fd:		file descriptor from cycles_open()
+ *
+ * Without a perf counter, the time stamp counter is used on x86.
+ *
+ * Return:	the number of cycles spent, 0 if unknown.
+ */
+static uint64_t cycles_read(const int fd)
+{
+	uint64_t cycles = 0;
+
+	if (fd >= 0) {
+		if (read(fd, &cycles, sizeof(cycles)) != sizeof(cycles))
+			return 0;
+
+		return cycles;
+	}
+
+#if defined(__x86_64__) || defined(__i386__)
+	cycles = __rdtsc();
+#endif
+
+	return cycles;
+}
+
+/**
+ * struct bench_result - measurement of a single benchmark
+ *
+ * @ns:		nanoseconds per frame
+ * @spread:	median absolute deviation of @ns between batches
+ * @bytes:	bytes written per second
+ * @cycles:	CPU cycles per pixel, 0 if unknown
+ */
+struct bench_result {
+	double ns;
+	double spread;
+	double bytes;
+	double cycles;
+};
+
+static int bench_compare(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * bench_median() - get the median of a number of measurements
+ *
+ * @ns:		measurements to get the median of, sorted on return
+ * @count:	number of measurements in @ns, odd
+ *
+ * Return:	the median of @ns.
+ */
+static double bench_median(double *ns, const size_t count)
+{
+	qsort(ns, count, sizeof(*ns), bench_compare);
+
+	return ns[count / 2];
+}
+
+/**
+ * bench_run() - measure a single benchmark
+ *
+ * @bench:	benchmark to run
+ * @ctx:	pointer to a valid and initialized bench_ctx struct
+ * @cyclesfd:	file descriptor from cycles_open()
+ * @result:	returns the measurement
+ *
+ * The number of frames per batch is doubled until a batch takes at least
+ * BENCH_BATCH_NS. The median of BENCH_BATCHES batches is reported, along with
+ * the spread between them, so that a single batch disturbed by the rest of the
+ * system does not move the result.
+ */
+static void bench_run(const struct bench_case *bench, struct bench_ctx *ctx,
+		      const int cyclesfd, struct bench_result *result)
+{
+	double ns[BENCH_BATCHES], cycles[BENCH_BATCHES];
+	uint64_t frames = 1;
+	size_t bytes = 0;
+	unsigned int batch;
+
+	for (;;) {
+		uint64_t begin, i;
+
+		bench_setup(ctx);
+		begin = now_ns();
+		for (i = 0; i < frames; i++)
+			bytes = bench->run(ctx);
+		if ((now_ns() - begin) >= BENCH_BATCH_NS)
+			break;
+		frames *= 2;
+	}
+
+	for (batch = 0; batch < BENCH_BATCHES; batch++) {
+		uint64_t begin, count, i;
+
+		bench_setup(ctx);
+		count = cycles_read(cyclesfd);
+		begin = now_ns();
+		for (i = 0; i < frames; i++)
+			bench->run(ctx);
+		ns[batch] = (double)(now_ns() - begin) / frames;
+		count = cycles_read(cyclesfd) - count;
+		cycles[batch] = count ? (double)count / frames /
+			((uint64_t)ctx->disp.xres * ctx->disp.yres) : 0;
+	}
+
+	result->cycles = bench_median(cycles, BENCH_BATCHES);
+	result->ns = bench_median(ns, BENCH_BATCHES);
+	for (batch = 0; batch < BENCH_BATCHES; batch++)
+		ns[batch] = fabs(ns[batch] - result->ns);
+	result->spread = bench_median(ns, BENCH_BATCHES);
+	result->bytes = bytes * ((double)NSEC_PER_SEC / result->ns);
+}
+
+/**
+ * bench_ctx_init() - set up a synthetic display to benchmark against
+ *
+ * @ctx:	bench_ctx structure to initialize
+ * @geometry:	resolution of the display
+ *
+ * Return:	0 on success, an error code otherwise.
+ */
+static int bench_ctx_init(struct bench_ctx *ctx, const struct bench_geometry *geometry)
+{
+	size_t size;
+
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->disp.xres = geometry->xres;
+	ctx->disp.yres = geometry->yres;
+	disp_format_set(&ctx->disp, &pixel_formats[geometry->format]);
+	ctx->disp.line_length = geometry->xres * ctx->disp.bpp;
+	ctx->disp.fb_len = (size_t)ctx->disp.line_length * geometry->yres;
+	disp_frame_init(&ctx->disp);
+	ctx->disp.pages = 1;
+	ctx->disp.id = "bench";
+
+	size = ARENA_SIZE(ctx->disp.fb_len) + band_lines_size(&ctx->disp) +
+	       damage_size(&ctx->disp, INPUT_DEFAULT_XSIZE, INPUT_DEFAULT_YSIZE) +
+	       coverage_size(&ctx->disp, INPUT_DEFAULT_XSIZE, INPUT_DEFAULT_YSIZE);
+	if (arena_init(&ctx->arena, size, false))
+		return -ENOMEM;
+
+	ctx->disp.fb = arena_alloc(&ctx->arena, ctx->disp.fb_len);
+	ctx->bands = band_lines_init(&ctx->disp, &ctx->arena);
+	if (damage_init(&ctx->damage, &ctx->arena, &ctx->disp, INPUT_DEFAULT_XSIZE, INPUT_DEFAULT_YSIZE) ||
+	    coverage_init(&ctx->coverage, &ctx->arena, &ctx->disp, INPUT_DEFAULT_XSIZE, INPUT_DEFAULT_YSIZE))
+		return -ENOMEM;
+
+	if (!ctx->disp.fb || !ctx->bands)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/**
+ * bench_ctx_free() - release a synthetic display
+ *
+ * @ctx:	bench_ctx structure to clean up
+ */
+static void bench_ctx_free(struct bench_ctx *ctx)
+{
+	arena_free(&ctx->arena);
+}
+
+/**
+ * render_check() - check that frames render the same with any number of threads
+ *
+ * @ctx:	pointer to a valid and initialized bench_ctx struct
+ * @bands:	banded lines of the display, or NULL to render without banding
+ * @name:	name to report a mismatch with
+ * @geometry:	resolution to report a mismatch with
+ *
+ * A full frame is rendered by a single thread first, and then by render
+ * pools of up to BENCH_THREADS_MAX threads, splitting it into stripes.
+ *
+ * Return:	false if any frame differs from the single thread one, true
+ *		otherwise.
+ */
+static bool render_check(struct bench_ctx *ctx, const uint8_t *bands,
+			 const char *name, const char *geometry)
+{
+	struct render_pipeline pipe;
+	struct render_job job = {
+		.damage = &ctx->damage,
+		.buffer = ctx->disp.fb,
+		.disp = &ctx->disp,
+		.pipe = &pipe,
+		.full = true,
+	};
+	uint8_t *reference;
+	uint32_t threads;
+	bool ret = true;
+
+	reference = malloc(ctx->disp.fb_len);
+	if (!reference) {
+		fprintf(stderr, "Failed to allocate memory: %s\n", strerror(errno));
+		return false;
+	}
+
+	render_pipeline_select(&pipe, &ctx->disp, bands, 1, INPUT_DEFAULT_FADE);
+	for (threads = 1; threads <= BENCH_THREADS_MAX; threads++) {
+		struct render_pool pool;
+
+		if (render_pool_init(&pool, threads)) {
+			fprintf(stderr, "Unable to start %u render threads\n", threads);
+			render_pool_free(&pool);
+			ret = false;
+			break;
+		}
+		bench_setup(ctx);
+		memset(ctx->disp.fb, 0, ctx->disp.fb_len);
+		render_pool_draw(&pool, &job);
+		render_pool_free(&pool);
+
+		if (threads == 1) {
+			memcpy(reference, ctx->disp.fb, ctx->disp.fb_len);
+		} else if (memcmp(reference, ctx->disp.fb, ctx->disp.fb_len)) {
+			fprintf(stderr, "Mismatch: %s at %s differs between 1 and %u threads\n",
+				name, geometry, threads);
+			ret = false;
+		}
+	}
+	free(reference);
+
+	return ret;
+}
+
+/**
+ * replay_log_event() - append an event to an input log
+ *
+ * @file:	input log to write to
+ * @codec:	delta coding state of @file
+ * @type:	type of the event
+ * @code:	code of the event
+ * @value:	value of the event
+ *
+ * All events are written as recorded at the same time.
+ */
+static void replay_log_event(FILE *file, struct input_log_codec *codec, const unsigned int type,
+			     const unsigned int code, int32_t value)
+{
+	int32_t *prev = input_log_delta(codec, type, code);
+
+	input_log_put(file, 0);
+	putc(type, file);
+	input_log_put(file, code);
+	if (prev) {
+		int32_t delta = (uint32_t)value - (uint32_t)*prev;
+
+		*prev = value;
+		value = delta;
+	}
+	input_log_put(file, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+/**
+ * replay_check() - check that a replay without delays loses no samples
+ *
+ * An input log of BENCH_REPLAY_SAMPLES touches, several times the size of the
+ * input ring, is replayed as fast as possible, while the samples are dequeued
+ * slower than a single batch at a time.
+ *
+ * Return:	false if not every touch was queued, true otherwise.
+ */
+static bool replay_check(void)
+{
+	struct input_sample samples[INPUT_BATCH_SIZE];
+	char path[] = "/tmp/ucit-bench-XXXXXX";
+	struct input_filter filter = { 0 };
+	struct input_log_codec codec = { 0 };
+	struct input_reader reader;
+	struct input_dev input;
+	uint64_t popped = 0;
+	uint64_t start;
+	FILE *file;
+	bool ret;
+	int fd;
+	int i;
+
+	fd = mkstemp(path);
+	file = (fd < 0) ? NULL : fdopen(fd, "wb");
+	if (!file) {
+		fprintf(stderr, "Unable to create input log: %s\n", strerror(errno));
+		if (fd >= 0) {
+			close(fd);
+			unlink(path);
+		}
+		return false;
+	}
+	fwrite(INPUT_LOG_MAGIC, 1, sizeof(INPUT_LOG_MAGIC) - 1, file);
+	for (i = 0; i < BENCH_REPLAY_SAMPLES; i++) {
+		replay_log_event(file, &codec, EV_ABS, ABS_X, i % 800);
+		replay_log_event(file, &codec, EV_ABS, ABS_Y, i % 480);
+		replay_log_event(file, &codec, EV_SYN, SYN_REPORT, 0);
+	}
+	ret = !fclose(file);
+
+	input.ops = &replay_input_ops;
+	input.priv = ret ? replay_open(path, 0.0) : NULL;
+	unlink(path);
+	if (!input.priv || input_reader_start(&reader, &input, &filter)) {
+		fprintf(stderr, "Unable to replay input log\n");
+		if (input.priv)
+			replay_input_free(&input);
+		return false;
+	}
+
+	start = now_ns();
+	while ((now_ns() - start) < BENCH_REPLAY_TIMEOUT_NS) {
+		struct timespec ts = { .tv_nsec = 100 * NSEC_PER_USEC };
+		size_t count;
+
+		count = input_reader_pop(&reader, samples, ARRAY_SIZE(samples));
+		popped += count;
+		if (!count && __atomic_load_n(&reader.error, __ATOMIC_ACQUIRE))
+			break;
+		nanosleep(&ts, NULL);
+	}
+	input_reader_stop(&reader);
+	replay_input_free(&input);
+
+	ret = (popped == BENCH_REPLAY_SAMPLES) && !reader.overflows;
+	if (!ret)
+		fprintf(stderr, "Mismatch: replay without delays queued %" PRIu64 " of %u samples, %" PRIu64 " dropped\n",
+			popped, BENCH_REPLAY_SAMPLES, reader.overflows);
+
+	return ret;
+}
+
+/**
+ * baseline_find() - look up a benchmark in the baseline
+ *
+ * @baseline:	baseline file as written by --save
+ * @name:	name of the benchmark
+ * @geometry:	resolution the benchmark ran at
+ * @ns:		returns the nanoseconds per frame of the baseline
+ *
+ * Return:	true if the benchmark is in the baseline, false otherwise.
+ */
+static bool baseline_find(FILE *baseline, const char *name, const char *geometry, double *ns)
+{
+	char line[256];
+
+	rewind(baseline);
+	while (fgets(line, sizeof(line), baseline)) {
+		char base_name[128], base_geometry[32];
+
+		if ((line[0] == '#') ||
+		    (sscanf(line, "%127s %31s %lf", base_name, base_geometry, ns) != 3) ||
+		    strcmp(base_name, name) || strcmp(base_geometry, geometry))
+			continue;
+
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * bench_regressed() - compare a measurement against its baseline
+ *
+ * @result:	measurement of the benchmark
+ * @base_ns:	nanoseconds per frame of the baseline
+ * @tolerance:	percentage a benchmark may be slower than its baseline
+ *
+ * On top of @tolerance, a benchmark may be slower by BENCH_SPREAD_FACTOR times
+ * the spread of the measurement, and never counts as slower by less than
+ * BENCH_NOISE_NS, the noise of the measurement of the fastest kernels.
+ *
+ * Return:	true if the benchmark regressed, false otherwise.
+ */
+static bool bench_regressed(const struct bench_result *result, const double base_ns,
+			    const unsigned int tolerance)
+{
+	double noise = BENCH_SPREAD_FACTOR * result->spread;
+
+	if (noise < BENCH_NOISE_NS)
+		noise = BENCH_NOISE_NS;
+
+	return result->ns > ((base_ns * (100 + tolerance) / 100) + noise);
+}
+
+static void bench_usage(char *argv0)
+{
+	printf("Usage: %s [OPTION] ...\n"
+	       "  -a, --advisory			report regressions against the baseline without failing\n"
+	       "  -b, --baseline=<file>		fail if slower than the results in <file>\n"
+	       "  -s, --save=<file>		save the results as baseline to <file>\n"
+	       "  -t, --tolerance=<percent>	allowed slowdown against the baseline (default %u)\n"
+	       "  -h, --help			display this help and exit\n"
+	       "\n"
+	       "Results are printed as tab separated columns of name, resolution, ns/frame,\n"
+	       "bytes/s and cycles/pixel. Cycles are counted by perf, or by the time stamp\n"
+	       "counter on x86, and are 0 if they can not be counted. Every result is the\n"
+	       "median of %u batches. A benchmark that appears slower than its baseline is\n"
+	       "measured up to %u more times before it counts as a regression.\n"
+	       "\n"
+	       "Before benchmarking, every frame is checked to render identically with 1 up to\n"
+	       "%u threads, and an input log replayed without delays to lose no samples.\n",
+	       argv0, BENCH_DEFAULT_TOLERANCE, BENCH_BATCHES, BENCH_RETRIES, BENCH_THREADS_MAX);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct option long_options[] = {
+		{ "advisory",	no_argument,		NULL, 'a' },
+		{ "baseline",	required_argument,	NULL, 'b' },
+		{ "save",	required_argument,	NULL, 's' },
+		{ "tolerance",	required_argument,	NULL, 't' },
+		{ "help",	no_argument,		NULL, 'h' },
+		{ NULL,		0,			NULL, 0 }
+	};
+	unsigned int tolerance = BENCH_DEFAULT_TOLERANCE;
+	FILE *baseline = NULL, *save = NULL;
+	bool advisory = false;
+	bool regressed = false;
+	bool mismatch = false;
+	int cyclesfd;
+	size_t g;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "ab:s:t:h", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'a':
+			advisory = true;
+			break;
+		case 'b':
+			baseline = fopen(optarg, "r");
+			if (baseline)
+				break;
+			/* Without a baseline yet, there is nothing to regress against. */
+			if (errno == ENOENT) {
+				fprintf(stderr, "No baseline '%s', not checking for regressions\n", optarg);
+				break;
+			}
+			fprintf(stderr, "Unable to open baseline '%s': %s\n", optarg, strerror(errno));
+			return EXIT_FAILURE;
+		case 's':
+			save = fopen(optarg, "w");
+			if (!save) {
+				fprintf(stderr, "Unable to create baseline '%s': %s\n", optarg, strerror(errno));
+				return EXIT_FAILURE;
+			}
+			break;
+		case 't':
+			tolerance = atoi(optarg);
+			break;
+		case 'h':
+			bench_usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	cyclesfd = cycles_open();
+
+	if (!replay_check())
+		mismatch = true;
+
+	printf("# name\tresolution\tns/frame\tbytes/s\tcycles/pixel\n");
+	if (save)
+		fprintf(save, "# name\tresolution\tns/frame\tbytes/s\tcycles/pixel\n");
+
+	for (g = 0; g < ARRAY_SIZE(bench_geometries); g++) {
+		struct bench_ctx ctx;
+		char geometry[32];
+		size_t b, k;
+
+		/* the default format is left out, keeping older baselines valid */
+		if (bench_geometries[g].format)
+			snprintf(geometry, sizeof(geometry), "%ux%ux%s",
+				 bench_geometries[g].xres, bench_geometries[g].yres,
+				 pixel_formats[bench_geometries[g].format].name);
+		else
+			snprintf(geometry, sizeof(geometry), "%ux%u",
+				 bench_geometries[g].xres, bench_geometries[g].yres);
+		if (bench_ctx_init(&ctx, &bench_geometries[g])) {
+			fprintf(stderr, "Failed to allocate memory for %s\n", geometry);
+			bench_ctx_free(&ctx);
+			return EXIT_FAILURE;
+		}
+
+		for (k = 0; k < ARRAY_SIZE(render_kernels); k++) {
+			char name[128];
+
+			kernel = &render_kernels[k];
+			if (kernel->supported && !kernel->supported())
+				continue;
+			snprintf(name, sizeof(name), "background_draw/%s", kernel->name);
+			if (!render_check(&ctx, NULL, name, geometry))
+				mismatch = true;
+			snprintf(name, sizeof(name), "background_draw_banding/%s", kernel->name);
+			if (!render_check(&ctx, ctx.bands, name, geometry))
+				mismatch = true;
+		}
+
+		for (b = 0; b < ARRAY_SIZE(bench_cases); b++) {
+			const struct bench_case *bench = &bench_cases[b];
+
+			for (k = 0; k < ARRAY_SIZE(render_kernels); k++) {
+				struct bench_result result;
+				unsigned int retry;
+				char name[128];
+				double base_ns;
+				bool checked;
+
+				kernel = &render_kernels[k];
+				if (bench->kernels) {
+					if (kernel->supported && !kernel->supported())
+						continue;
+					snprintf(name, sizeof(name), "%s/%s", bench->name, kernel->name);
+				} else {
+					kernel = &render_kernels[ARRAY_SIZE(render_kernels) - 1];
+					snprintf(name, sizeof(name), "%s", bench->name);
+				}
+
+				bench_run(bench, &ctx, cyclesfd, &result);
+				checked = baseline && baseline_find(baseline, name, geometry, &base_ns);
+				if (baseline && !checked)
+					fprintf(stderr, "No baseline for %s at %s\n", name, geometry);
+
+				/* A slower run may be due to the rest of the system, measure again. */
+				for (retry = 0; checked && (retry < BENCH_RETRIES) &&
+				     bench_regressed(&result, base_ns, tolerance); retry++) {
+					struct bench_result again;
+
+					bench_run(bench, &ctx, cyclesfd, &again);
+					if (again.ns < result.ns)
+						result = again;
+				}
+
+				printf("%s\t%s\t%.0f\t%.0f\t%.3f\n", name, geometry,
+				       result.ns, result.bytes, result.cycles);
+				if (save)
+					fprintf(save, "%s\t%s\t%.0f\t%.0f\t%.3f\n", name, geometry,
+						result.ns, result.bytes, result.cycles);
+				if (checked && bench_regressed(&result, base_ns, tolerance)) {
+					fprintf(stderr, "Regression: %s at %s takes %.0f ns/frame, baseline %.0f ns/frame\n",
+						name, geometry, result.ns, base_ns);
+					regressed = true;
+				}
+
+				if (!bench->kernels)
+					break;
+			}
+		}
+
+		bench_ctx_free(&ctx);
+	}
+
+	if (cyclesfd >= 0)
+		close(cyclesfd);
+	if (save)
+		fclose(save);
+	if (baseline)
+		fclose(baseline);
+
+	if (regressed && advisory)
+		fprintf(stderr, "Regressions are advisory, not failing\n");
+
+	return ((regressed && !advisory) || mismatch) ? EXIT_FAILURE : EXIT_SUCCESS;
+}